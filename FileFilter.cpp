@@ -0,0 +1,157 @@
+//===--- tools/extra/clang-rename/FileFilter.cpp - Clang rename tool ------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Rules out the files of a translation unit that the occurrence
+/// finder need not look at.
+///
+//===----------------------------------------------------------------------===//
+
+#include "FileFilter.h"
+#include "LexicalFilter.h"
+#include "RenamingAction.h"
+#include "clang/AST/DeclBase.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/SourceManager.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include <algorithm>
+#include <tuple>
+
+using namespace llvm;
+
+namespace clang {
+namespace rename {
+
+FileFilter::FileFilter(const SourceManager &SourceMgr, StringRef Name,
+                       ArrayRef<std::string> ExcludedPaths,
+                       ArrayRef<FileID> Collected)
+    : SourceMgr(SourceMgr) {
+  for (const auto &Path : ExcludedPaths) {
+    std::string Canonical = getCanonicalPath(Path);
+    while (Canonical.size() > 1 && sys::path::is_separator(Canonical.back()))
+      Canonical.pop_back();
+    this->ExcludedPaths.push_back(std::move(Canonical));
+  }
+
+  // Whether each file spells the name; a header included more than once is
+  // only scanned once.
+  const bool CheckName = isIdentifier(Name);
+  bool NameInMacro = false;
+  DenseMap<const FileEntry *, bool> Spells;
+  std::vector<std::pair<FileID, const FileEntry *>> UserFiles;
+
+  for (unsigned I = 0, E = SourceMgr.local_sloc_entry_size(); I != E; ++I) {
+    const auto &Entry = SourceMgr.getLocalSLocEntry(I);
+    if (!Entry.isFile())
+      continue;
+    // A file's entry starts at the offset its first location encodes.
+    const FileID ID = SourceMgr.getFileID(
+        SourceLocation::getFromRawEncoding(Entry.getOffset()));
+    if (ID.isInvalid())
+      continue;
+    const auto &Info = Entry.getFile();
+    const auto *Cache = Info.getContentCache();
+    const FileEntry *File = Cache ? Cache->OrigEntry : nullptr;
+    // The predefines and other buffers are kept.
+    Files[ID] = true;
+    if (!File)
+      continue;
+
+    if (CheckName) {
+      auto Inserted = Spells.insert(std::make_pair(File, true));
+      const auto *Buffer = Cache->getRawBuffer();
+      if (Inserted.second && Buffer) {
+        const StringRef Text = Buffer->getBuffer();
+        Inserted.first->second = containsIdentifier(Text, Name);
+        if (Inserted.first->second && isInMacroDefinition(Text, Name))
+          NameInMacro = true;
+      }
+    }
+
+    if (Info.getFileCharacteristic() != SrcMgr::C_User ||
+        (!this->ExcludedPaths.empty() &&
+         isExcluded(getCanonicalPath(SourceMgr, ID))))
+      Files[ID] = false;
+    else
+      UserFiles.push_back(std::make_pair(ID, File));
+  }
+
+  if (CheckName && !NameInMacro)
+    for (const auto &UserFile : UserFiles)
+      Files[UserFile.first] = Spells.lookup(UserFile.second);
+  for (const auto ID : Collected)
+    Files[ID] = false;
+
+  // Declarations of files that are ruled out may still #include files that
+  // are not, e.g. "namespace n {\n#include "decls.inc"\n}". Remember where,
+  // up the include stack to the first file that is not ruled out either.
+  for (const auto &File : Files) {
+    if (!File.second)
+      continue;
+    SourceLocation Loc = SourceMgr.getIncludeLoc(File.first);
+    while (Loc.isValid()) {
+      FileID Parent;
+      unsigned Offset;
+      std::tie(Parent, Offset) =
+          SourceMgr.getDecomposedLoc(SourceMgr.getExpansionLoc(Loc));
+      auto It = Files.find(Parent);
+      if (It == Files.end() || It->second)
+        break;
+      Inclusions[Parent].push_back(Offset);
+      Loc = SourceMgr.getIncludeLoc(Parent);
+    }
+  }
+  for (auto &Inclusion : Inclusions) {
+    auto &Offsets = Inclusion.second;
+    std::sort(Offsets.begin(), Offsets.end());
+    Offsets.erase(std::unique(Offsets.begin(), Offsets.end()), Offsets.end());
+  }
+}
+
+bool FileFilter::isExcluded(StringRef Path) const {
+  for (const auto &Excluded : ExcludedPaths)
+    if (Path.startswith(Excluded) &&
+        (Path.size() == Excluded.size() ||
+         sys::path::is_separator(Path[Excluded.size()]) ||
+         sys::path::is_separator(Excluded.back())))
+      return true;
+  return false;
+}
+
+bool FileFilter::mayContainOccurrences(const Decl &D) const {
+  const SourceRange Range = D.getSourceRange();
+  if (Range.isInvalid())
+    return true;
+
+  FileID File;
+  unsigned Begin;
+  std::tie(File, Begin) =
+      SourceMgr.getDecomposedLoc(SourceMgr.getExpansionLoc(Range.getBegin()));
+  auto It = Files.find(File);
+  if (It == Files.end() || It->second)
+    return true;
+
+  FileID EndFile;
+  unsigned End;
+  std::tie(EndFile, End) = SourceMgr.getDecomposedLoc(
+      SourceMgr.getExpansionRange(Range.getEnd()).second);
+  if (EndFile != File)
+    return true;
+
+  auto I = Inclusions.find(File);
+  if (I == Inclusions.end())
+    return false;
+  const auto &Offsets = I->second;
+  auto Next = std::lower_bound(Offsets.begin(), Offsets.end(), Begin);
+  return Next != Offsets.end() && *Next <= End;
+}
+
+}
+}
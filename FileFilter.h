@@ -0,0 +1,70 @@
+//===--- tools/extra/clang-rename/FileFilter.h - Clang rename tool --------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Rules out the files of a translation unit that the occurrence
+/// finder need not look at.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_FILE_FILTER_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_FILE_FILTER_H
+
+#include "clang/Basic/SourceLocation.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include <string>
+#include <vector>
+
+namespace clang {
+
+class Decl;
+class SourceManager;
+
+namespace rename {
+
+// The files of a translation unit that cannot hold an occurrence to rename:
+// system headers, which are never rewritten, files under excluded paths, and
+// files that do not spell the name of the symbol. Headers whose occurrences
+// were collected from another translation unit may be ruled out as well.
+//
+// Declarations at namespace scope that lie in such a file are skipped as a
+// whole, unless they #include a file that is not ruled out. Files are only
+// ruled out for not spelling the name if no file of the translation unit
+// names it in a macro definition, as a macro may spell it for them.
+class FileFilter {
+public:
+  // Name is the spelling of the symbol, as getLocationsOfUSRs takes it.
+  // ExcludedPaths are files or directories; paths below them are ruled out.
+  // Collected are the headers to rule out as collected already.
+  FileFilter(const SourceManager &SourceMgr, llvm::StringRef Name,
+             llvm::ArrayRef<std::string> ExcludedPaths,
+             llvm::ArrayRef<FileID> Collected = llvm::None);
+
+  // Returns whether D, a declaration at namespace scope, may hold an
+  // occurrence to rename.
+  bool mayContainOccurrences(const Decl &D) const;
+
+private:
+  bool isExcluded(llvm::StringRef Path) const;
+
+  const SourceManager &SourceMgr;
+  std::vector<std::string> ExcludedPaths;
+  // Every file of the translation unit, and whether it may hold occurrences.
+  llvm::DenseMap<FileID, bool> Files;
+  // For the files ruled out, the sorted offsets of the #include directives
+  // leading to files that are not.
+  llvm::DenseMap<FileID, std::vector<unsigned>> Inclusions;
+};
+
+}
+}
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_FILE_FILTER_H
@@ -0,0 +1,145 @@
+//===--- tools/extra/clang-rename/HeaderFingerprint.cpp - Clang rename tool ==//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Tells when a header parses the same in two translation units, so
+/// that the occurrences in it are only collected once per rename.
+///
+//===----------------------------------------------------------------------===//
+
+#include "HeaderFingerprint.h"
+#include "RenamingAction.h"
+#include "StableHash.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Basic/TargetInfo.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Lex/MacroInfo.h"
+#include "clang/Lex/Token.h"
+
+using namespace llvm;
+
+namespace clang {
+namespace rename {
+
+// Continues Hash with String, preceded by its size so that consecutive
+// strings cannot run into each other.
+static uint64_t hashString(StringRef String, uint64_t Hash) {
+  return hashBytes(String, hashWord(String.size(), Hash));
+}
+
+HeaderFingerprinter::HeaderFingerprinter(const CompilerInstance &CI)
+    : SourceMgr(CI.getSourceManager()) {
+  const LangOptions &LangOpts = CI.getLangOpts();
+  uint64_t Hash = EmptyStableHash;
+#define LANGOPT(Name, Bits, Default, Description)                              \
+  Hash = hashWord(LangOpts.Name, Hash);
+#define ENUM_LANGOPT(Name, Type, Bits, Default, Description)                   \
+  Hash = hashWord(static_cast<unsigned>(LangOpts.get##Name()), Hash);
+#include "clang/Basic/LangOptions.def"
+  OptionsHash = hashString(CI.getTarget().getTriple().str(), Hash);
+}
+
+void HeaderFingerprinter::getFingerprints(
+    std::vector<std::pair<FileID, uint64_t>> &Fingerprints) const {
+  const FileID MainFile = SourceMgr.getMainFileID();
+  for (unsigned I = 0, E = SourceMgr.local_sloc_entry_size(); I != E; ++I) {
+    const auto &Entry = SourceMgr.getLocalSLocEntry(I);
+    if (!Entry.isFile())
+      continue;
+    // A file's entry starts at the offset its first location encodes.
+    const FileID ID = SourceMgr.getFileID(
+        SourceLocation::getFromRawEncoding(Entry.getOffset()));
+    const auto *Cache = Entry.getFile().getContentCache();
+    const FileEntry *File = Cache ? Cache->OrigEntry : nullptr;
+    if (ID.isInvalid() || ID == MainFile || !File)
+      continue;
+
+    uint64_t Hash = hashString(getCanonicalPath(SourceMgr, ID), OptionsHash);
+    Hash = hashWord(File->getSize(), Hash);
+    Hash = hashWord(File->getModificationTime(), Hash);
+    Hash = hashWord(MacroHashes.lookup(ID), Hash);
+    Fingerprints.push_back(std::make_pair(ID, Hash));
+  }
+}
+
+void HeaderFingerprinter::MacroExpands(const Token &MacroNameTok,
+                                       const MacroDirective *MD,
+                                       SourceRange Range,
+                                       const MacroArgs *Args) {
+  addMacro(Range.getBegin(), MacroNameTok, MD);
+}
+
+void HeaderFingerprinter::Defined(const Token &MacroNameTok,
+                                  const MacroDirective *MD,
+                                  SourceRange Range) {
+  addMacro(MacroNameTok.getLocation(), MacroNameTok, MD);
+}
+
+void HeaderFingerprinter::Ifdef(SourceLocation Loc, const Token &MacroNameTok,
+                                const MacroDirective *MD) {
+  addMacro(Loc, MacroNameTok, MD);
+}
+
+void HeaderFingerprinter::Ifndef(SourceLocation Loc, const Token &MacroNameTok,
+                                 const MacroDirective *MD) {
+  addMacro(Loc, MacroNameTok, MD);
+}
+
+void HeaderFingerprinter::addMacro(SourceLocation Loc,
+                                   const Token &MacroNameTok,
+                                   const MacroDirective *MD) {
+  if (Loc.isInvalid())
+    return;
+  const FileID File = SourceMgr.getFileID(SourceMgr.getExpansionLoc(Loc));
+  auto &Hash =
+      MacroHashes.insert(std::make_pair(File, EmptyStableHash)).first->second;
+  const IdentifierInfo *Name = MacroNameTok.getIdentifierInfo();
+  Hash = hashString(Name ? Name->getName() : StringRef(), Hash);
+  Hash = hashWord(getDefinitionHash(MD ? MD->getMacroInfo() : nullptr), Hash);
+}
+
+uint64_t HeaderFingerprinter::getDefinitionHash(const MacroInfo *Info) {
+  if (!Info)
+    return 0;
+  auto It = DefinitionHashes.find(Info);
+  if (It != DefinitionHashes.end())
+    return It->second;
+
+  // Definitions are compared by their tokens rather than by where they are,
+  // as those on the command line are at different offsets of the predefines
+  // of different translation units.
+  uint64_t Hash = hashWord(Info->isFunctionLike() | Info->isVariadic() << 1 |
+                           Info->isBuiltinMacro() << 2);
+  for (auto I = Info->arg_begin(), E = Info->arg_end(); I != E; ++I)
+    Hash = hashString((*I)->getName(), Hash);
+  for (auto I = Info->tokens_begin(), E = Info->tokens_end(); I != E; ++I) {
+    Hash = hashWord(I->getKind() | I->hasLeadingSpace() << 16, Hash);
+    if (const IdentifierInfo *II = I->getIdentifierInfo())
+      Hash = hashString(II->getName(), Hash);
+    else if (I->isLiteral() && I->getLiteralData())
+      Hash = hashString(StringRef(I->getLiteralData(), I->getLength()), Hash);
+  }
+  DefinitionHashes[Info] = Hash;
+  return Hash;
+}
+
+bool CollectedHeaders::contains(uint64_t Fingerprint) const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  return Fingerprints.count(Fingerprint);
+}
+
+void CollectedHeaders::insert(ArrayRef<uint64_t> Fingerprints) {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  this->Fingerprints.insert(Fingerprints.begin(), Fingerprints.end());
+}
+
+}
+}
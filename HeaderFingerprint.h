@@ -0,0 +1,96 @@
+//===--- tools/extra/clang-rename/HeaderFingerprint.h - Clang rename tool -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Tells when a header parses the same in two translation units, so
+/// that the occurrences in it are only collected once per rename.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_HEADER_FINGERPRINT_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_HEADER_FINGERPRINT_H
+
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include <cstdint>
+#include <mutex>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace clang {
+
+class CompilerInstance;
+class MacroInfo;
+
+namespace rename {
+
+// Fingerprints the headers of a translation unit while it is preprocessed.
+// A fingerprint covers the header's path, size and modification time, the
+// language options and target, and every macro the header expands or tests,
+// with the definition it saw, or that it saw none. Two inclusions with the
+// same fingerprint read the same tokens.
+//
+// That they also mean the same assumes headers are self-contained: a header
+// that uses declarations of whatever was included before it may refer to
+// different entities in different translation units.
+class HeaderFingerprinter : public PPCallbacks {
+public:
+  explicit HeaderFingerprinter(const CompilerInstance &CI);
+
+  // Appends the fingerprint of every header of the translation unit, that
+  // is of every file but the main file, to Fingerprints.
+  void getFingerprints(
+      std::vector<std::pair<FileID, uint64_t>> &Fingerprints) const;
+
+  void MacroExpands(const Token &MacroNameTok, const MacroDirective *MD,
+                    SourceRange Range, const MacroArgs *Args) override;
+  void Defined(const Token &MacroNameTok, const MacroDirective *MD,
+               SourceRange Range) override;
+  void Ifdef(SourceLocation Loc, const Token &MacroNameTok,
+             const MacroDirective *MD) override;
+  void Ifndef(SourceLocation Loc, const Token &MacroNameTok,
+              const MacroDirective *MD) override;
+
+private:
+  // Adds the macro named by MacroNameTok, as defined by MD, to the
+  // fingerprint of the file Loc is in.
+  void addMacro(SourceLocation Loc, const Token &MacroNameTok,
+                const MacroDirective *MD);
+  uint64_t getDefinitionHash(const MacroInfo *Info);
+
+  const SourceManager &SourceMgr;
+  // The language options and the target.
+  uint64_t OptionsHash;
+  // The macros each file used so far.
+  llvm::DenseMap<FileID, uint64_t> MacroHashes;
+  llvm::DenseMap<const MacroInfo *, uint64_t> DefinitionHashes;
+};
+
+// The fingerprints of the headers whose occurrences a rename collected
+// already. Shared by all of its workers.
+class CollectedHeaders {
+public:
+  // Returns whether a header with Fingerprint was collected.
+  bool contains(uint64_t Fingerprint) const;
+
+  // Records that the headers with Fingerprints were collected.
+  void insert(llvm::ArrayRef<uint64_t> Fingerprints);
+
+private:
+  mutable std::mutex Mutex;
+  std::unordered_set<uint64_t> Fingerprints;
+};
+
+}
+}
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_HEADER_FINGERPRINT_H
@@ -0,0 +1,39 @@
+//===--- tools/extra/clang-rename/JSONWriter.cpp - Clang rename tool ------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Writing of the JSON the tool produces: compile_filedeps.json, the
+/// time trace and the databases of the benchmark projects.
+///
+//===----------------------------------------------------------------------===//
+
+#include "JSONWriter.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace clang {
+namespace rename {
+
+void writeJSONString(raw_ostream &OS, StringRef S) {
+  OS << '"';
+  for (char C : S) {
+    if (C == '"' || C == '\\')
+      OS << '\\' << C;
+    else if (static_cast<unsigned char>(C) < 0x20)
+      OS << format("\\u%04x", C);
+    else
+      OS << C;
+  }
+  OS << '"';
+}
+
+}
+}
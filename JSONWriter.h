@@ -0,0 +1,34 @@
+//===--- tools/extra/clang-rename/JSONWriter.h - Clang rename tool --------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Writing of the JSON the tool produces: compile_filedeps.json, the
+/// time trace and the databases of the benchmark projects.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_JSON_WRITER_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_JSON_WRITER_H
+
+#include "llvm/ADT/StringRef.h"
+
+namespace llvm {
+class raw_ostream;
+}
+
+namespace clang {
+namespace rename {
+
+// Writes S as a JSON string, quoted and escaped.
+void writeJSONString(llvm::raw_ostream &OS, llvm::StringRef S);
+
+}
+}
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_JSON_WRITER_H
@@ -0,0 +1,160 @@
+//===--- tools/extra/clang-rename/LexicalFilter.cpp - Clang rename tool ---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Cheap textual checks that rule out translation units before they
+/// are parsed.
+///
+/// Files are memory mapped and searched for the first character of the name
+/// with memchr, which the C library implements with vector instructions;
+/// only candidate positions are compared in full.
+///
+//===----------------------------------------------------------------------===//
+
+#include "LexicalFilter.h"
+#include "src/DependencyDatabase.h"
+#include "clang/Basic/CharInfo.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace llvm;
+
+namespace clang {
+namespace rename {
+
+// Returns where Name first occurs in Buffer from From on, delimited like an
+// identifier, or null.
+static const char *findIdentifier(StringRef Buffer, size_t From,
+                                  StringRef Name) {
+  if (Name.empty() || Buffer.size() < From + Name.size())
+    return nullptr;
+
+  const char *Begin = Buffer.data();
+  const char *End = Begin + Buffer.size();
+  const char *Last = End - Name.size();
+  const char First = Name[0];
+  StringRef Rest = Name.drop_front();
+
+  for (const char *P = Begin + From; P <= Last; ++P) {
+    P = static_cast<const char *>(std::memchr(P, First, Last - P + 1));
+    if (!P)
+      return nullptr;
+    if (StringRef(P + 1, Rest.size()) != Rest)
+      continue;
+    if (P != Begin && isIdentifierBody(P[-1]))
+      continue;
+    if (P + Name.size() != End && isIdentifierBody(P[Name.size()]))
+      continue;
+    return P;
+  }
+  return nullptr;
+}
+
+bool containsIdentifier(StringRef Buffer, StringRef Name) {
+  return findIdentifier(Buffer, 0, Name) != nullptr;
+}
+
+bool isInMacroDefinition(StringRef Buffer, StringRef Name) {
+  for (const char *P = findIdentifier(Buffer, 0, Name); P;
+       P = findIdentifier(Buffer, P - Buffer.data() + Name.size(), Name)) {
+    // Back up to the start of the line, across escaped newlines.
+    size_t Start = P - Buffer.data();
+    while (Start) {
+      const size_t Newline = Buffer.rfind('\n', Start);
+      if (Newline == StringRef::npos) {
+        Start = 0;
+        break;
+      }
+      size_t Escape = Newline;
+      if (Escape && Buffer[Escape - 1] == '\r')
+        --Escape;
+      if (!Escape || Buffer[Escape - 1] != '\\') {
+        Start = Newline + 1;
+        break;
+      }
+      Start = Escape - 1;
+    }
+
+    StringRef Line = Buffer.substr(Start);
+    Line = Line.substr(std::min(Line.find_first_not_of(" \t"), Line.size()));
+    if (!Line.startswith("#"))
+      continue;
+    Line = Line.drop_front();
+    Line = Line.substr(std::min(Line.find_first_not_of(" \t"), Line.size()));
+    if (Line.startswith("define") &&
+        (Line.size() == 6 || !isIdentifierBody(Line[6])))
+      return true;
+  }
+  return false;
+}
+
+bool isIdentifier(StringRef Name) {
+  if (Name.empty() || isDigit(Name[0]))
+    return false;
+  for (char C : Name)
+    if (!isIdentifierBody(C))
+      return false;
+  return true;
+}
+
+namespace {
+// Remembers which files mention the name; headers are shared by many
+// translation units.
+class FileScanner {
+public:
+  explicit FileScanner(StringRef Name) : Name(Name) {
+  }
+
+  bool mentionsName(StringRef Path) {
+    auto &Entry = Results.GetOrCreateValue(Path, Unknown);
+    if (Entry.getValue() == Unknown)
+      Entry.setValue(scan(Path) ? Yes : No);
+    return Entry.getValue() == Yes;
+  }
+
+private:
+  enum Result { Unknown, Yes, No };
+
+  bool scan(StringRef Path) const {
+    auto Buffer = MemoryBuffer::getFile(Path, /*FileSize=*/-1,
+                                        /*RequiresNullTerminator=*/false);
+    // A file we cannot read may still mention the name.
+    if (!Buffer)
+      return true;
+    return containsIdentifier((*Buffer)->getBuffer(), Name);
+  }
+
+  StringRef Name;
+  StringMap<Result> Results;
+};
+} // namespace
+
+std::vector<TranslationUnit>
+filterTranslationUnits(ArrayRef<TranslationUnit> TUs, StringRef Name,
+                       const DependencyDatabase &DepDB) {
+  if (!isIdentifier(Name))
+    return TUs.vec();
+
+  FileScanner Scanner(Name);
+  std::vector<TranslationUnit> Result;
+  for (const auto &TU : TUs) {
+    const auto Deps = DepDB.getDependencies(TU.MainFile);
+    bool Keep = Deps.empty() || Scanner.mentionsName(TU.MainFile);
+    for (auto I = Deps.begin(), E = Deps.end(); !Keep && I != E; ++I)
+      Keep = Scanner.mentionsName(*I);
+    if (Keep)
+      Result.push_back(TU);
+  }
+  return Result;
+}
+
+}
+}
@@ -0,0 +1,53 @@
+//===--- tools/extra/clang-rename/LexicalFilter.h - Clang rename tool -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Cheap textual checks that rule out translation units before they
+/// are parsed.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_LEXICAL_FILTER_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_LEXICAL_FILTER_H
+
+#include "ParallelRunner.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include <vector>
+
+class DependencyDatabase;
+
+namespace clang {
+namespace rename {
+
+// Returns whether Name can be spelled as a single identifier.
+bool isIdentifier(llvm::StringRef Name);
+
+// Returns whether Name occurs in Buffer delimited like an identifier. Comments
+// and string literals are not told apart, so this may give false positives
+// but never false negatives.
+bool containsIdentifier(llvm::StringRef Buffer, llvm::StringRef Name);
+
+// Returns whether Name occurs, delimited like an identifier, on a #define
+// line of Buffer, so that code expanding the macro may refer to Name without
+// spelling it.
+bool isInMacroDefinition(llvm::StringRef Buffer, llvm::StringRef Name);
+
+// Drops the translation units in which Name cannot be spelled, because
+// neither the main file nor any of its dependencies in DepDB contains it.
+// Translation units without known dependencies are always kept, as are all
+// of them if Name is not an identifier.
+std::vector<TranslationUnit>
+filterTranslationUnits(llvm::ArrayRef<TranslationUnit> TUs,
+                       llvm::StringRef Name, const DependencyDatabase &DepDB);
+
+}
+}
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_LEXICAL_FILTER_H
@@ -0,0 +1,838 @@
+//===--- tools/extra/clang-rename/ParallelRunner.cpp - Clang rename tool --===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Runs tool actions over translation units on a pool of worker
+/// threads or processes.
+///
+/// ClangTool chdir()s into the directory of every compile command, which
+/// changes the working directory of the whole process. Workers instead pass
+/// the directory to the driver with -working-directory and resolve relative
+/// paths through a FileManager set up for that directory.
+///
+/// A few large translation units tend to set the time a run takes, so they
+/// should not be started last. The translation units are dealt out to one
+/// queue per worker longest first, each to the queue with the least work, by
+/// the times recorded in earlier runs. Translation units without a recorded
+/// time are expected to take the mean. A worker takes the longest translation
+/// unit left in its own queue and, once that is empty, the shortest one left
+/// in another's, to make up for the times being off.
+///
+/// Every AST lives only as long as the tool invocation that parses it. With
+/// a memory budget, workers wait before parsing until the ASTs expected of
+/// the translation units in flight leave room for theirs. Sizes not known yet
+/// are taken to be the largest recorded, or an even share of the budget if
+/// none is.
+///
+/// Clang may crash or hang on a translation unit, and keeps some state per
+/// process. runInWorkerProcesses therefore forks a process per worker
+/// instead, which is handed one translation unit at a time through a pipe
+/// and streams its results back through a ring buffer in memory it shares
+/// with the parent. A second pipe rings the parent when there is something
+/// to read, and reaches the end of file when the worker exits. The results
+/// of a translation unit only count once all of them arrived, so a worker
+/// that crashes or is killed for taking too long loses nothing but the
+/// translation unit it ran, which a fresh worker tries again.
+///
+//===----------------------------------------------------------------------===//
+
+#include "ParallelRunner.h"
+#include "RenameStatistics.h"
+#include "StableHash.h"
+#include "TranslationUnitTimes.h"
+#include "src/DependencyDatabase.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/FileSystemOptions.h"
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <poll.h>
+#include <set>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace llvm;
+
+namespace clang {
+namespace rename {
+
+std::vector<TranslationUnit>
+getTranslationUnits(const tooling::CompilationDatabase &Compilations,
+                    ArrayRef<std::string> SourcePaths) {
+  std::vector<TranslationUnit> TUs;
+  std::set<std::pair<std::string, std::vector<std::string>>> Seen;
+
+  // Only a DependencyDatabase knows which source files a header's commands
+  // compile.
+  const auto *DepDB = DependencyDatabase::getLoaded();
+  if (DepDB && DepDB != &Compilations)
+    DepDB = nullptr;
+
+  // Its commands are compared by identity, and copied out once they are
+  // known to be new.
+  std::set<std::pair<const char *, const void *>> SeenRefs;
+
+  for (const auto &SourcePath : SourcePaths) {
+    std::string File(tooling::getAbsolutePath(SourcePath));
+
+    if (DepDB) {
+      auto Refs = DepDB->getCompileCommandRefs(File);
+      for (const auto &Ref : Refs) {
+        if (!SeenRefs.insert(Ref.getKey()).second)
+          continue;
+        TUs.push_back(TranslationUnit(File, Ref.File, Ref.toCompileCommand()));
+      }
+      if (Refs.empty())
+        errs() << "Skipping " << File << ". Compile command not found.\n";
+      continue;
+    }
+
+    auto Commands = Compilations.getCompileCommands(File);
+    if (Commands.empty())
+      errs() << "Skipping " << File << ". Compile command not found.\n";
+    for (auto &Command : Commands) {
+      if (!Seen.insert(std::make_pair(Command.Directory,
+                                      Command.CommandLine)).second)
+        continue;
+      TUs.push_back(TranslationUnit(File, File, std::move(Command)));
+    }
+  }
+
+  return TUs;
+}
+
+std::vector<TranslationUnit>
+getTranslationUnits(const DependencyDatabase &DepDB, const BitVector &Entries) {
+  std::vector<TranslationUnit> TUs;
+  std::set<std::pair<const char *, const void *>> Seen;
+  for (const auto &Ref : DepDB.getCompileCommandRefs(Entries))
+    if (Seen.insert(Ref.getKey()).second)
+      TUs.push_back(
+          TranslationUnit(Ref.File, Ref.File, Ref.toCompileCommand()));
+  return TUs;
+}
+
+namespace {
+// Used to locate the resource directory the same way ClangTool does.
+int StaticSymbol;
+
+class Worker {
+public:
+  Worker(tooling::ToolAction *Action, StringRef MainExecutable)
+      : Action(Action), MainExecutable(MainExecutable) {
+  }
+
+  bool run(const TranslationUnit &TU) {
+    PhaseTimer Timer("translation unit", TU.MainFile);
+    const auto &Command = TU.Command;
+    tooling::ToolInvocation Invocation(adjustCommandLine(Command), Action,
+                                       getFileManager(Command.Directory));
+    return Invocation.run();
+  }
+
+private:
+  // Applies the argument adjusters ClangTool installs by default.
+  std::vector<std::string>
+  adjustCommandLine(const tooling::CompileCommand &Command) const {
+    tooling::ClangSyntaxOnlyAdjuster SyntaxOnly;
+    tooling::ClangStripOutputAdjuster StripOutput;
+
+    auto CommandLine =
+        StripOutput.Adjust(SyntaxOnly.Adjust(Command.CommandLine));
+    assert(!CommandLine.empty());
+    CommandLine[0] = MainExecutable;
+    if (!Command.Directory.empty()) {
+      CommandLine.push_back("-working-directory");
+      CommandLine.push_back(Command.Directory);
+    }
+    return CommandLine;
+  }
+
+  // FileManagers are kept per directory so that the stat cache is shared by
+  // all the commands a worker runs in that directory.
+  FileManager *getFileManager(StringRef Directory) {
+    auto &Files = FileManagers[Directory];
+    if (!Files) {
+      FileSystemOptions Options;
+      Options.WorkingDir = Directory;
+      Files = new FileManager(Options);
+    }
+    return Files.get();
+  }
+
+  tooling::ToolAction *Action;
+  StringRef MainExecutable;
+  StringMap<IntrusiveRefCntPtr<FileManager>> FileManagers;
+};
+
+// The translation units dealt to one worker, longest first.
+struct WorkQueue {
+  std::mutex Mutex;
+  std::deque<size_t> TUs;
+};
+
+// Admits translation units while their expected ASTs fit the budget.
+class MemoryBudget {
+public:
+  explicit MemoryBudget(uint64_t Limit) : Limit(Limit), InUse(0), Running(0) {
+  }
+
+  // Waits until Bytes fit next to the ASTs in flight, or none are.
+  void acquire(uint64_t Bytes) {
+    std::unique_lock<std::mutex> Lock(Mutex);
+    if (Running && InUse + Bytes > Limit) {
+      ++getStatistics().MemoryWaits;
+      Released.wait(Lock,
+                    [&] { return !Running || InUse + Bytes <= Limit; });
+    }
+    InUse += Bytes;
+    ++Running;
+  }
+
+  void release(uint64_t Bytes) {
+    {
+      std::lock_guard<std::mutex> Lock(Mutex);
+      InUse -= Bytes;
+      --Running;
+    }
+    Released.notify_all();
+  }
+
+private:
+  const uint64_t Limit;
+  uint64_t InUse;
+  unsigned Running;
+  std::mutex Mutex;
+  std::condition_variable Released;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double getSeconds(Clock::duration Duration) {
+  return std::chrono::duration<double>(Duration).count();
+}
+} // namespace
+
+// Returns the time every one of TUs is expected to take.
+static std::vector<double> predictTimes(ArrayRef<TranslationUnit> TUs,
+                                        const TranslationUnitTimes *Times) {
+  std::vector<double> Expected(TUs.size(), -1);
+  double Known = 0;
+  size_t NumKnown = 0;
+  if (Times) {
+    for (size_t I = 0, E = TUs.size(); I != E; ++I) {
+      if (Times->lookup(TUs[I].Command, Expected[I])) {
+        Known += Expected[I];
+        ++NumKnown;
+      }
+    }
+    getStatistics().UntimedTUs += TUs.size() - NumKnown;
+  }
+  const double Mean = NumKnown ? Known / NumKnown : 1;
+  for (auto &Time : Expected)
+    if (Time < 0)
+      Time = Mean;
+  return Expected;
+}
+
+// Returns the indices of Expected, longest first. A stable sort keeps the
+// given order among equals, e.g. without recorded times.
+static std::vector<size_t> sortLongestFirst(ArrayRef<double> Expected) {
+  std::vector<size_t> Order(Expected.size());
+  for (size_t I = 0, E = Order.size(); I != E; ++I)
+    Order[I] = I;
+  std::stable_sort(Order.begin(), Order.end(), [&](size_t A, size_t B) {
+    return Expected[A] > Expected[B];
+  });
+  return Order;
+}
+
+// Deals the translation units out to Queues longest first, each to the queue
+// with the least work, and returns the time the fullest queue is expected to
+// take.
+static double schedule(ArrayRef<double> Expected,
+                       std::vector<WorkQueue> &Queues) {
+  std::vector<double> Loads(Queues.size());
+  for (size_t I : sortLongestFirst(Expected)) {
+    const size_t Least =
+        std::min_element(Loads.begin(), Loads.end()) - Loads.begin();
+    Queues[Least].TUs.push_back(I);
+    Loads[Least] += Expected[I];
+  }
+  return *std::max_element(Loads.begin(), Loads.end());
+}
+
+// Returns the memory the AST of every one of TUs is expected to take.
+static std::vector<uint64_t>
+predictMemory(ArrayRef<TranslationUnit> TUs, const TranslationUnitTimes *Times,
+              uint64_t MaxMemory, unsigned NumWorkers) {
+  std::vector<uint64_t> Expected(TUs.size());
+  uint64_t Largest = 0;
+  if (Times) {
+    for (size_t I = 0, E = TUs.size(); I != E; ++I) {
+      if (Times->lookupMemory(TUs[I].Command, Expected[I]))
+        Largest = std::max(Largest, Expected[I]);
+    }
+  }
+  for (auto &Bytes : Expected)
+    if (!Bytes)
+      Bytes = Largest ? Largest : MaxMemory / NumWorkers;
+  return Expected;
+}
+
+// The AST memory reported for the translation unit this thread runs.
+static LLVM_THREAD_LOCAL uint64_t CurrentASTMemory;
+
+static std::mutex OutputMutex;
+
+void printFromWorker(StringRef Message) {
+  std::lock_guard<std::mutex> Lock(OutputMutex);
+  errs() << Message;
+}
+
+void reportASTMemory(const ASTContext &Context) {
+  const auto &SourceMgr = Context.getSourceManager();
+  const auto Buffers = SourceMgr.getMemoryBufferSizes();
+  CurrentASTMemory = Context.getASTAllocatedMemory() +
+                     Context.getSideTableAllocatedMemory() +
+                     SourceMgr.getDataStructureSizes() +
+                     Buffers.malloc_bytes + Buffers.mmap_bytes;
+}
+
+// Takes the next translation unit for worker WorkerIndex: the longest left in
+// its own queue, or else the shortest left in the next queue that has any.
+static bool takeWork(std::vector<WorkQueue> &Queues, unsigned WorkerIndex,
+                     size_t &TU) {
+  {
+    auto &Own = Queues[WorkerIndex];
+    std::lock_guard<std::mutex> Lock(Own.Mutex);
+    if (!Own.TUs.empty()) {
+      TU = Own.TUs.front();
+      Own.TUs.pop_front();
+      return true;
+    }
+  }
+  for (unsigned I = 1, E = Queues.size(); I < E; ++I) {
+    auto &Victim = Queues[(WorkerIndex + I) % E];
+    std::lock_guard<std::mutex> Lock(Victim.Mutex);
+    if (!Victim.TUs.empty()) {
+      TU = Victim.TUs.back();
+      Victim.TUs.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+int runOnTranslationUnits(ArrayRef<TranslationUnit> TUs,
+                          ArrayRef<tooling::ToolAction *> WorkerActions,
+                          const TranslationUnitCallback &Done,
+                          TranslationUnitTimes *Times, uint64_t MaxMemory) {
+  assert(!WorkerActions.empty() && "no workers to run on");
+
+  const std::string MainExecutable =
+      sys::fs::getMainExecutable("clang_tool", &StaticSymbol);
+
+  std::vector<WorkQueue> Queues(WorkerActions.size());
+  const double Predicted = schedule(predictTimes(TUs, Times), Queues);
+  std::vector<uint64_t> Footprints;
+  if (MaxMemory)
+    Footprints = predictMemory(TUs, Times, MaxMemory, WorkerActions.size());
+  MemoryBudget Budget(MaxMemory);
+  std::atomic<bool> ProcessingFailed(false);
+
+  auto RunWorker = [&](unsigned WorkerIndex) {
+    Worker W(WorkerActions[WorkerIndex], MainExecutable);
+    size_t I;
+    while (takeWork(Queues, WorkerIndex, I)) {
+      if (MaxMemory)
+        Budget.acquire(Footprints[I]);
+      CurrentASTMemory = 0;
+      const auto Start = Clock::now();
+      const bool Succeeded = W.run(TUs[I]);
+      const auto Elapsed = Clock::now() - Start;
+      // The AST is gone once the invocation returns.
+      if (MaxMemory)
+        Budget.release(Footprints[I]);
+      // Failures stop early and would skew the schedule.
+      if (Times && Succeeded) {
+        Times->record(TUs[I].Command, getSeconds(Elapsed));
+        if (CurrentASTMemory)
+          Times->recordMemory(TUs[I].Command, CurrentASTMemory);
+      }
+      if (!Succeeded) {
+        printFromWorker("Error while processing " + TUs[I].File + ".\n");
+        ProcessingFailed = true;
+      }
+      if (Done)
+        Done(I, WorkerIndex, Succeeded);
+    }
+  };
+
+  // Keep the calling thread busy with the first worker.
+  const auto Start = Clock::now();
+  std::vector<std::thread> Threads;
+  for (unsigned I = 1, E = WorkerActions.size(); I < E; ++I)
+    Threads.push_back(std::thread(RunWorker, I));
+  RunWorker(0);
+  for (auto &Thread : Threads)
+    Thread.join();
+
+  if (Times) {
+    auto &Stats = getStatistics();
+    Stats.PredictedMakespan += uint64_t(Predicted * 1e6);
+    Stats.ActualMakespan += uint64_t(getSeconds(Clock::now() - Start) * 1e6);
+  }
+
+  return ProcessingFailed ? 1 : 0;
+}
+
+namespace {
+// A byte stream from a worker process to the parent, in memory both map.
+// The worker only advances Head and the parent only advances Tail.
+struct Ring {
+  static const size_t Capacity = 4 << 20;
+
+  std::atomic<uint64_t> Head;
+  std::atomic<uint64_t> Tail;
+  char Data[Capacity];
+};
+
+// Every translation unit a worker process runs is answered with one message:
+// the index of the translation unit, whether it succeeded, the memory its AST
+// reported and the size of its results, followed by the results.
+struct MessageHeader {
+  uint32_t TU;
+  uint32_t Succeeded;
+  uint64_t ASTMemory;
+  uint64_t Size;
+};
+
+// The parent's end of a worker process.
+struct WorkerProcess {
+  WorkerProcess()
+      : Pid(0), CommandFD(-1), DoorbellFD(-1), Channel(nullptr), Busy(false),
+        TU(0), TimedOut(false) {
+  }
+
+  pid_t Pid;
+  // Indices of translation units to run are written here.
+  int CommandFD;
+  // The worker writes a byte here whenever it wrote to Channel. Reading the
+  // end of file means it exited.
+  int DoorbellFD;
+  Ring *Channel;
+  // Bytes read from Channel that do not make a whole message yet.
+  std::string Pending;
+  bool Busy;
+  size_t TU;
+  Clock::time_point Start;
+  bool TimedOut;
+};
+} // namespace
+
+// Writes Size bytes at Data to Channel, waiting for the parent to make room.
+static void writeToRing(Ring &Channel, int DoorbellFD, const char *Data,
+                        size_t Size) {
+  uint64_t Head = Channel.Head.load(std::memory_order_relaxed);
+  while (Size) {
+    const uint64_t Tail = Channel.Tail.load(std::memory_order_acquire);
+    const size_t Free = Ring::Capacity - (Head - Tail);
+    if (!Free) {
+      ::write(DoorbellFD, "", 1);
+      ::usleep(1000);
+      continue;
+    }
+    const size_t Offset = Head % Ring::Capacity;
+    const size_t Chunk =
+        std::min(std::min(Free, Size), Ring::Capacity - Offset);
+    memcpy(Channel.Data + Offset, Data, Chunk);
+    Data += Chunk;
+    Size -= Chunk;
+    Head += Chunk;
+    Channel.Head.store(Head, std::memory_order_release);
+  }
+  ::write(DoorbellFD, "", 1);
+}
+
+// Appends what was written to Channel since the last call to Bytes.
+static void readFromRing(Ring &Channel, std::string &Bytes) {
+  uint64_t Tail = Channel.Tail.load(std::memory_order_relaxed);
+  const uint64_t Head = Channel.Head.load(std::memory_order_acquire);
+  while (Tail != Head) {
+    const size_t Offset = Tail % Ring::Capacity;
+    const size_t Chunk =
+        std::min<uint64_t>(Head - Tail, Ring::Capacity - Offset);
+    Bytes.append(Channel.Data + Offset, Chunk);
+    Tail += Chunk;
+  }
+  Channel.Tail.store(Tail, std::memory_order_release);
+}
+
+// Reads exactly Size bytes from FD. Returns false at the end of file.
+static bool readAll(int FD, char *Data, size_t Size) {
+  while (Size) {
+    const ssize_t Read = ::read(FD, Data, Size);
+    if (Read < 0 && errno == EINTR)
+      continue;
+    if (Read <= 0)
+      return false;
+    Data += Read;
+    Size -= Read;
+  }
+  return true;
+}
+
+// Runs the translation units the parent sends until it closes CommandFD.
+LLVM_ATTRIBUTE_NORETURN
+static void runWorkerProcess(ArrayRef<TranslationUnit> TUs,
+                             tooling::ToolAction *Action,
+                             const ResultWriter &WriteResults,
+                             StringRef MainExecutable, int CommandFD,
+                             int DoorbellFD, Ring &Channel) {
+  Worker W(Action, MainExecutable);
+  uint32_t Index;
+  std::string Results;
+  while (readAll(CommandFD, reinterpret_cast<char *>(&Index), sizeof(Index))) {
+    CurrentASTMemory = 0;
+    MessageHeader Header;
+    Header.TU = Index;
+    Header.Succeeded = W.run(TUs[Index]);
+    Header.ASTMemory = CurrentASTMemory;
+    Results.clear();
+    WriteResults(Results);
+    Header.Size = Results.size();
+    writeToRing(Channel, DoorbellFD, reinterpret_cast<const char *>(&Header),
+                sizeof(Header));
+    writeToRing(Channel, DoorbellFD, Results.data(), Results.size());
+  }
+  // Leave the parent's buffers and atexit handlers alone.
+  ::_exit(0);
+}
+
+int runInWorkerProcesses(ArrayRef<TranslationUnit> TUs, unsigned NumWorkers,
+                         tooling::ToolAction *Action,
+                         const ResultWriter &WriteResults,
+                         const ResultReader &ReadResults, unsigned Timeout,
+                         unsigned Retries, TranslationUnitTimes *Times,
+                         uint64_t MaxMemory) {
+  assert(NumWorkers && "no workers to run on");
+
+  const std::string MainExecutable =
+      sys::fs::getMainExecutable("clang_tool", &StaticSymbol);
+
+  // The parent hands out the longest translation unit left to the next idle
+  // worker, which is what the per-worker queues of threads amount to.
+  const auto Expected = predictTimes(TUs, Times);
+  const auto Order = sortLongestFirst(Expected);
+  std::deque<size_t> Waiting(Order.begin(), Order.end());
+  std::vector<WorkQueue> Queues(NumWorkers);
+  const double Predicted = schedule(Expected, Queues);
+  std::vector<uint64_t> Footprints;
+  if (MaxMemory)
+    Footprints = predictMemory(TUs, Times, MaxMemory, NumWorkers);
+  uint64_t MemoryInUse = 0;
+  std::vector<unsigned> Attempts(TUs.size());
+  // The translation unit last counted as waiting for memory.
+  size_t Delayed = TUs.size();
+  bool ProcessingFailed = false;
+
+  // The rings are mapped before any worker is forked, so that every worker
+  // started in a slot shares that slot's ring with the parent.
+  std::vector<WorkerProcess> Workers(NumWorkers);
+  for (auto &W : Workers) {
+    void *Memory = ::mmap(nullptr, sizeof(Ring), PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (Memory == MAP_FAILED) {
+      errs() << "clang-rename: cannot map worker memory: "
+             << std::strerror(errno) << "\n";
+      for (auto &Mapped : Workers)
+        if (Mapped.Channel)
+          ::munmap(Mapped.Channel, sizeof(Ring));
+      return 1;
+    }
+    W.Channel = new (Memory) Ring;
+  }
+
+  // A worker that died must not take the parent along when it is written to.
+  struct sigaction IgnorePipe, OldPipe;
+  memset(&IgnorePipe, 0, sizeof(IgnorePipe));
+  IgnorePipe.sa_handler = SIG_IGN;
+  ::sigaction(SIGPIPE, &IgnorePipe, &OldPipe);
+
+  auto Spawn = [&](WorkerProcess &W) {
+    int Command[2], Doorbell[2];
+    if (::pipe(Command))
+      return false;
+    if (::pipe(Doorbell)) {
+      ::close(Command[0]);
+      ::close(Command[1]);
+      return false;
+    }
+    W.Channel->Head = 0;
+    W.Channel->Tail = 0;
+    W.Pending.clear();
+    const pid_t Pid = ::fork();
+    if (Pid == 0) {
+      // Only the parent may hold the ends of the other workers' pipes, or
+      // they would not see it close them.
+      for (const auto &Other : Workers) {
+        if (Other.Pid) {
+          ::close(Other.CommandFD);
+          ::close(Other.DoorbellFD);
+        }
+      }
+      ::close(Command[1]);
+      ::close(Doorbell[0]);
+      ::fcntl(Doorbell[1], F_SETFL, O_NONBLOCK);
+      runWorkerProcess(TUs, Action, WriteResults, MainExecutable, Command[0],
+                       Doorbell[1], *W.Channel);
+    }
+    ::close(Command[0]);
+    ::close(Doorbell[1]);
+    if (Pid < 0) {
+      ::close(Command[1]);
+      ::close(Doorbell[0]);
+      return false;
+    }
+    ::fcntl(Doorbell[0], F_SETFL, O_NONBLOCK);
+    W.Pid = Pid;
+    W.CommandFD = Command[1];
+    W.DoorbellFD = Doorbell[0];
+    return true;
+  };
+
+  // Hands out translation units to idle workers while memory allows.
+  auto Dispatch = [&]() {
+    unsigned Running = 0;
+    for (const auto &W : Workers)
+      Running += W.Busy;
+    for (auto &W : Workers) {
+      if (W.Busy || Waiting.empty())
+        continue;
+      const size_t I = Waiting.front();
+      if (MaxMemory && Running && MemoryInUse + Footprints[I] > MaxMemory) {
+        if (Delayed != I)
+          ++getStatistics().MemoryWaits;
+        Delayed = I;
+        return;
+      }
+      if (!W.Pid && !Spawn(W)) {
+        errs() << "clang-rename: cannot start a worker process: "
+               << std::strerror(errno) << "\n";
+        if (Running)
+          return;
+        // Nothing left to run on.
+        ProcessingFailed = true;
+        Waiting.clear();
+        return;
+      }
+      Waiting.pop_front();
+      const uint32_t Index = I;
+      // A worker that died before reading this is found out by poll().
+      ::write(W.CommandFD, &Index, sizeof(Index));
+      W.Busy = true;
+      W.TU = I;
+      W.Start = Clock::now();
+      W.TimedOut = false;
+      if (MaxMemory)
+        MemoryInUse += Footprints[I];
+      ++Running;
+    }
+  };
+
+  auto Finish = [&](WorkerProcess &W) {
+    W.Busy = false;
+    if (MaxMemory)
+      MemoryInUse -= Footprints[W.TU];
+  };
+
+  // Handles the whole messages W sent so far.
+  auto Receive = [&](WorkerProcess &W) {
+    readFromRing(*W.Channel, W.Pending);
+    size_t Offset = 0;
+    MessageHeader Header;
+    while (W.Pending.size() - Offset >= sizeof(Header)) {
+      memcpy(&Header, W.Pending.data() + Offset, sizeof(Header));
+      if (W.Pending.size() - Offset - sizeof(Header) < Header.Size)
+        break;
+      const StringRef Results(W.Pending.data() + Offset + sizeof(Header),
+                              Header.Size);
+      Offset += sizeof(Header) + Header.Size;
+      if (!W.Busy || Header.TU != W.TU)
+        continue;
+
+      if (Header.Succeeded) {
+        if (Times) {
+          Times->record(TUs[W.TU].Command,
+                        getSeconds(Clock::now() - W.Start));
+          if (Header.ASTMemory)
+            Times->recordMemory(TUs[W.TU].Command, Header.ASTMemory);
+        }
+      } else {
+        errs() << "Error while processing " << TUs[W.TU].File << ".\n";
+        ProcessingFailed = true;
+      }
+      // Whatever a failed translation unit found is kept, as with threads.
+      ReadResults(W.TU, Results);
+      Finish(W);
+    }
+    W.Pending.erase(0, Offset);
+  };
+
+  // Reaps W once it exited, and retries or reports what it was running.
+  auto Reap = [&](WorkerProcess &W) {
+    Receive(W);
+    int Status = 0;
+    while (::waitpid(W.Pid, &Status, 0) < 0 && errno == EINTR)
+      ;
+    ::close(W.CommandFD);
+    ::close(W.DoorbellFD);
+    W.Pid = 0;
+    if (!W.Busy)
+      return;
+
+    const auto &TU = TUs[W.TU];
+    std::string Reason;
+    if (W.TimedOut)
+      Reason = "timed out after " + std::to_string(Timeout) + "s";
+    else if (WIFSIGNALED(Status))
+      Reason = "crashed with signal " + std::to_string(WTERMSIG(Status));
+    else
+      Reason = "exited with status " + std::to_string(WEXITSTATUS(Status));
+    ++getStatistics().WorkerCrashes;
+    Finish(W);
+    if (Attempts[W.TU]++ < Retries) {
+      errs() << "clang-rename: worker " << Reason << " on " << TU.File
+             << ", retrying.\n";
+      Waiting.push_front(W.TU);
+      return;
+    }
+    errs() << "Error while processing " << TU.File << ": worker " << Reason
+           << ".\n";
+    ProcessingFailed = true;
+  };
+
+  const auto Start = Clock::now();
+  for (;;) {
+    Dispatch();
+    std::vector<pollfd> Polled;
+    std::vector<WorkerProcess *> PolledWorkers;
+    int Wait = -1;
+    const auto Now = Clock::now();
+    for (auto &W : Workers) {
+      if (!W.Pid)
+        continue;
+      pollfd FD = { W.DoorbellFD, POLLIN, 0 };
+      Polled.push_back(FD);
+      PolledWorkers.push_back(&W);
+      if (!W.Busy || !Timeout || W.TimedOut)
+        continue;
+      const auto Left = W.Start + std::chrono::seconds(Timeout) - Now;
+      const int LeftMS = std::max<int64_t>(
+          0, std::chrono::duration_cast<std::chrono::milliseconds>(Left)
+                     .count() + 1);
+      Wait = Wait < 0 ? LeftMS : std::min(Wait, LeftMS);
+    }
+    bool Busy = false;
+    for (const auto &W : Workers)
+      Busy |= W.Busy;
+    if (!Busy && Waiting.empty())
+      break;
+
+    if (::poll(Polled.data(), Polled.size(), Wait) < 0 && errno != EINTR) {
+      errs() << "clang-rename: poll: " << std::strerror(errno) << "\n";
+      ProcessingFailed = true;
+      break;
+    }
+
+    for (size_t I = 0, E = Polled.size(); I != E; ++I) {
+      auto &W = *PolledWorkers[I];
+      if (!Polled[I].revents)
+        continue;
+      char Doorbell[256];
+      ssize_t Read;
+      while ((Read = ::read(W.DoorbellFD, Doorbell, sizeof(Doorbell))) > 0)
+        ;
+      if (Read == 0)
+        Reap(W);
+      else
+        Receive(W);
+    }
+
+    if (Timeout) {
+      const auto Now = Clock::now();
+      for (auto &W : Workers) {
+        if (W.Busy && !W.TimedOut &&
+            Now - W.Start >= std::chrono::seconds(Timeout)) {
+          // Its pipe reaches the end of file once it is gone.
+          ::kill(W.Pid, SIGKILL);
+          W.TimedOut = true;
+        }
+      }
+    }
+  }
+
+  // Closing the command pipes lets the idle workers exit.
+  for (auto &W : Workers) {
+    if (W.Pid) {
+      if (W.Busy)
+        ::kill(W.Pid, SIGKILL);
+      ::close(W.CommandFD);
+      while (::waitpid(W.Pid, nullptr, 0) < 0 && errno == EINTR)
+        ;
+      ::close(W.DoorbellFD);
+    }
+    W.Channel->~Ring();
+    ::munmap(W.Channel, sizeof(Ring));
+  }
+  ::sigaction(SIGPIPE, &OldPipe, nullptr);
+
+  if (Times) {
+    auto &Stats = getStatistics();
+    Stats.PredictedMakespan += uint64_t(Predicted * 1e6);
+    Stats.ActualMakespan += uint64_t(getSeconds(Clock::now() - Start) * 1e6);
+  }
+  return ProcessingFailed ? 1 : 0;
+}
+
+uint64_t getCommandHash(const tooling::CompileCommand &Command) {
+  // The directory and the NUL-terminated arguments.
+  uint64_t Hash = hashBytes(Command.Directory);
+  for (const auto &Arg : Command.CommandLine)
+    Hash = hashBytes(StringRef(Arg.c_str(), Arg.size() + 1), Hash);
+  return Hash;
+}
+
+unsigned getNumWorkers(unsigned Jobs, size_t NumTUs) {
+  const unsigned NumWorkers = Jobs ? Jobs : std::thread::hardware_concurrency();
+  return std::max(1u, std::min<unsigned>(NumWorkers, NumTUs));
+}
+
+} // namespace rename
+} // namespace clang
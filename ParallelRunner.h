@@ -0,0 +1,144 @@
+//===--- tools/extra/clang-rename/ParallelRunner.h - Clang rename tool ----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Runs tool actions over translation units on a pool of worker
+/// threads or processes.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_PARALLEL_RUNNER_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_PARALLEL_RUNNER_H
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class DependencyDatabase;
+
+namespace llvm {
+class BitVector;
+}
+
+namespace clang {
+
+class ASTContext;
+
+namespace tooling {
+class ToolAction;
+}
+
+namespace rename {
+
+class TranslationUnitTimes;
+
+// A single compile command a tool action is run with.
+struct TranslationUnit {
+  TranslationUnit(std::string File, std::string MainFile,
+                  tooling::CompileCommand Command)
+      : File(std::move(File)), MainFile(std::move(MainFile)),
+        Command(std::move(Command)) {
+  }
+
+  // The path the command was looked up for. For a header this is the header,
+  // not the source file the command compiles.
+  std::string File;
+  // The source file the command compiles, as far as the compilation database
+  // tells; File otherwise.
+  std::string MainFile;
+  tooling::CompileCommand Command;
+};
+
+// Looks up the compile commands for each of SourcePaths, in order. Headers
+// expand to the commands of every dependent translation unit, so commands
+// reached through more than one path are only returned once.
+std::vector<TranslationUnit>
+getTranslationUnits(const tooling::CompilationDatabase &Compilations,
+                    llvm::ArrayRef<std::string> SourcePaths);
+
+// Called on the thread of worker Worker once it ran TUs[Index], so that
+// results collected by its action may be attributed to the translation unit.
+typedef std::function<void(size_t Index, unsigned Worker, bool Succeeded)>
+    TranslationUnitCallback;
+
+// Returns the translation units of the given entries of DepDB, each compile
+// command once, with File set to the source file it compiles.
+std::vector<TranslationUnit>
+getTranslationUnits(const DependencyDatabase &DepDB,
+                    const llvm::BitVector &Entries);
+
+// Runs the translation units on one thread per worker action. Every worker
+// parses with its own CompilerInstance and FileManagers, so an action is only
+// ever used by a single thread and may collect results without locking.
+//
+// With Times, the translation units expected to take longest are started
+// first, and the time each takes is recorded in Times, along with the size
+// of its AST if the action reports it with reportASTMemory.
+//
+// With MaxMemory, a translation unit is only started while the ASTs expected
+// of it and of those being parsed fit in MaxMemory bytes, by the sizes in
+// Times. A translation unit that does not fit on its own is parsed alone.
+//
+// Returns 0 on success and 1 if any translation unit failed, like
+// ClangTool::run.
+int runOnTranslationUnits(
+    llvm::ArrayRef<TranslationUnit> TUs,
+    llvm::ArrayRef<tooling::ToolAction *> WorkerActions,
+    const TranslationUnitCallback &Done = TranslationUnitCallback(),
+    TranslationUnitTimes *Times = nullptr, uint64_t MaxMemory = 0);
+
+// Called in a worker process once it ran a translation unit, to move the
+// results its action collected into Results.
+typedef std::function<void(std::string &Results)> ResultWriter;
+
+// Called in this process with the results of TUs[Index], once all of them
+// arrived.
+typedef std::function<void(size_t Index, llvm::StringRef Results)>
+    ResultReader;
+
+// Runs the translation units like runOnTranslationUnits, but on NumWorkers
+// forked processes that each run Action, so that a crash or a hang only
+// loses the translation unit it happened in. That translation unit is run
+// again in a new process up to Retries times; a worker taking longer than
+// Timeout seconds on one, if not 0, is killed.
+//
+// Returns 0 on success and 1 if any translation unit failed.
+int runInWorkerProcesses(llvm::ArrayRef<TranslationUnit> TUs,
+                         unsigned NumWorkers, tooling::ToolAction *Action,
+                         const ResultWriter &WriteResults,
+                         const ResultReader &ReadResults, unsigned Timeout,
+                         unsigned Retries,
+                         TranslationUnitTimes *Times = nullptr,
+                         uint64_t MaxMemory = 0);
+
+// Tells the worker on this thread how much memory the AST of the translation
+// unit it runs holds: that of Context and of the source buffers. Actions call
+// this once the AST is complete.
+void reportASTMemory(const ASTContext &Context);
+
+// Prints Message to stderr at once, so that it does not interleave with what
+// the other worker threads print.
+void printFromWorker(llvm::StringRef Message);
+
+// Returns a hash of Command that, unlike llvm::hash_value, is stable across
+// runs.
+uint64_t getCommandHash(const tooling::CompileCommand &Command);
+
+// Returns the number of workers to run NumTUs translation units on when Jobs
+// were requested, 0 meaning one per hardware thread.
+unsigned getNumWorkers(unsigned Jobs, size_t NumTUs);
+
+}
+}
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_PARALLEL_RUNNER_H
@@ -0,0 +1,413 @@
+//===--- tools/extra/clang-rename/RenameDriver.cpp - Clang rename tool ----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief The steps of a rename, shared by the command line tool and the
+/// server.
+///
+/// Nothing here changes the working directory or keeps state between calls,
+/// so a long running process may rename again and again. Every call reads
+/// the files afresh.
+///
+/// The translation units of the first file are parsed one at a time until one
+/// resolves the symbol. That AST is kept and renamed in directly, so the
+/// translation unit is parsed once rather than once per pass.
+///
+/// Any translation unit referring to the symbol sees one of its declarations.
+/// With a dependency database, the translation units compiling or including
+/// the files of the declarations found in that AST are therefore all there is
+/// to rename in.
+///
+/// Linkage narrows this further, see SymbolScope. A local is renamed in its
+/// function and a private member of a class that is completely defined in the
+/// origin only there; neither needs another translation unit parsed. Entities
+/// without external linkage are renamed in the translation units that see
+/// their declarations, with or without -dependents. Configurations that
+/// compile a file differently are not told apart: the origin decides.
+///
+//===----------------------------------------------------------------------===//
+
+#include "RenameDriver.h"
+#include "HeaderFingerprint.h"
+#include "LexicalFilter.h"
+#include "ParallelRunner.h"
+#include "RenameStatistics.h"
+#include "RenamingAction.h"
+#include "SymbolIndex.h"
+#include "TranslationUnitTimes.h"
+#include "USRFinder.h"
+#include "USRFindingAction.h"
+#include "src/DependencyDatabase.h"
+#include "clang/AST/Decl.h"
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/TextDiagnosticPrinter.h"
+#include "clang/Rewrite/Core/Rewriter.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <set>
+
+using namespace llvm;
+
+namespace clang {
+namespace rename {
+
+namespace {
+// \brief Keeps the AST of the translation unit it is run on.
+class ASTBuildingAction : public tooling::ToolAction {
+public:
+  bool runInvocation(CompilerInvocation *Invocation, FileManager *Files,
+                     DiagnosticConsumer *DiagConsumer) override {
+    AST = std::unique_ptr<ASTUnit>(ASTUnit::LoadFromCompilerInvocation(
+        Invocation, CompilerInstance::createDiagnostics(
+                        &Invocation->getDiagnosticOpts(), DiagConsumer,
+                        /*ShouldOwnClient=*/false)));
+    return AST != nullptr;
+  }
+
+  std::unique_ptr<ASTUnit> takeAST() {
+    return std::move(AST);
+  }
+
+private:
+  std::unique_ptr<ASTUnit> AST;
+};
+
+// The translation unit a symbol was found in.
+struct Origin {
+  // The parsed translation unit, or null if the symbol was not found.
+  std::unique_ptr<ASTUnit> AST;
+  // Its compile command.
+  tooling::CompileCommand Command;
+  std::vector<std::string> USRs;
+  std::string Name;
+  // The files the symbol is declared in, as far as the AST tells.
+  std::vector<std::string> DeclarationFiles;
+  // Where references to the symbol can be.
+  SymbolScope Scope;
+  // The outermost function the symbol is local to, for SymbolScope::Function.
+  Decl *Enclosing;
+  // The source file the origin compiles.
+  std::string MainFile;
+};
+} // namespace
+
+// Returns the files the redeclarations of Decl are in.
+static std::vector<std::string> getDeclarationFiles(const NamedDecl &Decl) {
+  const auto &SourceMgr = Decl.getASTContext().getSourceManager();
+  std::set<std::string> Files;
+  for (const auto *Redecl : Decl.redecls()) {
+    const auto Loc = SourceMgr.getExpansionLoc(Redecl->getLocation());
+    const auto Path = getCanonicalPath(SourceMgr, SourceMgr.getFileID(Loc));
+    if (!Path.empty())
+      Files.insert(Path);
+  }
+  return std::vector<std::string>(Files.begin(), Files.end());
+}
+
+// Returns the outermost function Decl is local to, looking through lambdas
+// and local classes.
+static Decl *getEnclosingFunction(const NamedDecl &D) {
+  const DeclContext *Function = D.getParentFunctionOrMethod();
+  while (const auto *Outer =
+             Decl::castFromDeclContext(Function)->getParentFunctionOrMethod())
+    Function = Outer;
+  return Decl::castFromDeclContext(const_cast<DeclContext *>(Function));
+}
+
+// Parses the translation units of File until one of them resolves the symbol
+// at Offset, and returns it.
+static Origin findOrigin(const tooling::CompilationDatabase &Compilations,
+                         StringRef File, unsigned Offset, USRCache &Cache) {
+  // Workers resolve relative paths against the compile directory.
+  const std::string Path = tooling::getAbsolutePath(File);
+
+  Origin Result;
+  Result.Scope = SymbolScope::Global;
+  Result.Enclosing = nullptr;
+  for (const auto &TU : getTranslationUnits(Compilations, Path)) {
+    ASTBuildingAction Action;
+    tooling::ToolAction *Worker = &Action;
+    if (runOnTranslationUnits(TU, Worker) != 0)
+      continue;
+    auto AST = Action.takeAST();
+    PhaseTimer Timer("find symbol", TU.MainFile);
+    if (const auto *Decl = findUSRsAt(AST->getASTContext(), Path, Offset,
+                                      Cache, Result.USRs, Result.Name)) {
+      Result.DeclarationFiles = getDeclarationFiles(*Decl);
+      Result.Scope = getSymbolScope(*Decl);
+      if (Result.Scope == SymbolScope::Function)
+        Result.Enclosing = getEnclosingFunction(*Decl);
+      Result.AST = std::move(AST);
+      Result.Command = TU.Command;
+      Result.MainFile = TU.MainFile;
+      break;
+    }
+  }
+  return Result;
+}
+
+void findUSRs(const tooling::CompilationDatabase &Compilations,
+              StringRef File, const RenameOptions &Options,
+              std::vector<std::string> &USRs, std::string &PrevName) {
+  USRCache Cache;
+  auto Found = findOrigin(Compilations, File, Options.Offset, Cache);
+  USRs = std::move(Found.USRs);
+  PrevName = Found.AST ? std::move(Found.Name) : std::string();
+}
+
+// Renames in TUs on NumWorkers threads. Every worker collects into its own
+// set of replacements; merging the sets gives the same result a serial run
+// does.
+static int renameInWorkerThreads(ArrayRef<TranslationUnit> TUs,
+                                 unsigned NumWorkers,
+                                 const RenameOptions &Options,
+                                 const std::string &PrevName,
+                                 const std::vector<std::string> &USRs,
+                                 TranslationUnitTimes *Times,
+                                 CollectedHeaders *Headers,
+                                 tooling::Replacements &Replaces) {
+  std::vector<tooling::Replacements> WorkerReplaces(NumWorkers);
+  std::vector<std::unique_ptr<RenamingAction>> RenameActions;
+  std::vector<std::unique_ptr<tooling::FrontendActionFactory>> Factories;
+  std::vector<tooling::ToolAction *> WorkerActions;
+  for (auto &WorkerReplace : WorkerReplaces) {
+    RenameActions.emplace_back(new RenamingAction(
+        Options.NewName, PrevName, USRs, Options.ExcludedPaths, WorkerReplace,
+        Options.PrintLocations, Headers));
+    Factories.push_back(tooling::newFrontendActionFactory(
+        RenameActions.back().get(), RenameActions.back().get()));
+    WorkerActions.push_back(Factories.back().get());
+  }
+
+  int Result = runOnTranslationUnits(TUs, WorkerActions,
+                                     TranslationUnitCallback(), Times,
+                                     Options.MaxMemory);
+  for (const auto &WorkerReplace : WorkerReplaces)
+    Replaces.insert(WorkerReplace.begin(), WorkerReplace.end());
+  return Result;
+}
+
+// Appends Replaces to Bytes, each as its offset, length, and the sizes of its
+// path and text, followed by the path and the text.
+static void writeReplacements(const tooling::Replacements &Replaces,
+                              std::string &Bytes) {
+  for (const auto &Replace : Replaces) {
+    const StringRef Path = Replace.getFilePath();
+    const StringRef Text = Replace.getReplacementText();
+    const uint32_t Header[] = { Replace.getOffset(), Replace.getLength(),
+                                uint32_t(Path.size()), uint32_t(Text.size()) };
+    Bytes.append(reinterpret_cast<const char *>(Header), sizeof(Header));
+    Bytes.append(Path.data(), Path.size());
+    Bytes.append(Text.data(), Text.size());
+  }
+}
+
+// Reads the replacements writeReplacements wrote to Bytes into Replaces.
+static void readReplacements(StringRef Bytes, tooling::Replacements &Replaces) {
+  uint32_t Header[4];
+  while (Bytes.size() >= sizeof(Header)) {
+    memcpy(Header, Bytes.data(), sizeof(Header));
+    Bytes = Bytes.drop_front(sizeof(Header));
+    const StringRef Path = Bytes.substr(0, Header[2]);
+    const StringRef Text = Bytes.substr(Header[2], Header[3]);
+    Bytes = Bytes.drop_front(std::min<size_t>(Bytes.size(),
+                                              size_t(Header[2]) + Header[3]));
+    Replaces.insert(tooling::Replacement(Path, Header[0], Header[1], Text));
+  }
+}
+
+// Renames in TUs on NumWorkers forked processes, which send their
+// replacements back once a translation unit is done.
+static int renameInWorkerProcesses(ArrayRef<TranslationUnit> TUs,
+                                   unsigned NumWorkers,
+                                   const RenameOptions &Options,
+                                   const std::string &PrevName,
+                                   const std::vector<std::string> &USRs,
+                                   TranslationUnitTimes *Times,
+                                   CollectedHeaders *Headers,
+                                   tooling::Replacements &Replaces) {
+  // Every process gets its own copy of the action and of what it collects,
+  // and only shares headers between the translation units it runs.
+  tooling::Replacements WorkerReplaces;
+  RenamingAction Action(Options.NewName, PrevName, USRs,
+                        Options.ExcludedPaths, WorkerReplaces,
+                        Options.PrintLocations, Headers);
+  std::unique_ptr<tooling::FrontendActionFactory> Factory(
+      tooling::newFrontendActionFactory(&Action, &Action));
+
+  return runInWorkerProcesses(
+      TUs, NumWorkers, Factory.get(),
+      [&WorkerReplaces](std::string &Results) {
+        writeReplacements(WorkerReplaces, Results);
+        WorkerReplaces.clear();
+      },
+      [&Replaces](size_t, StringRef Results) {
+        readReplacements(Results, Replaces);
+      },
+      Options.Timeout, Options.Retries, Times, Options.MaxMemory);
+}
+
+int collectReplacements(const tooling::CompilationDatabase &Compilations,
+                        ArrayRef<std::string> Files,
+                        const RenameOptions &Options,
+                        tooling::Replacements &Replaces,
+                        std::string &PrevName) {
+  PrevName.clear();
+  if (Options.Index) {
+    if (renameFromIndex(*Options.Index, Compilations, Files[0],
+                        Options.Offset, Options.NewName, Replaces, PrevName,
+                        Options.PrintLocations)) {
+      if (Options.PrintName)
+        errs() << "clang-rename: found name: " << PrevName;
+      return 0;
+    }
+    errs() << "clang-rename: parsing instead.\n";
+  }
+
+  USRCache OriginCache;
+  auto Found = findOrigin(Compilations, Files[0], Options.Offset, OriginCache);
+  if (!Found.AST)
+    return 1;
+  PrevName = Found.Name;
+  const auto &USRs = Found.USRs;
+
+  if (Options.PrintName)
+    errs() << "clang-rename: found name: " << PrevName;
+
+  const auto *DepDB = DependencyDatabase::getLoaded();
+  if (DepDB != &Compilations)
+    DepDB = nullptr;
+
+  // Rename in the origin right away and leave it out of the parallel pass.
+  RenamingAction OriginAction(Options.NewName, PrevName, USRs,
+                              Options.ExcludedPaths, Replaces,
+                              Options.PrintLocations);
+  OriginAction.renameIn(Found.AST->getASTContext(), OriginCache,
+                        Found.Enclosing);
+  Found.AST.reset();
+  if (Found.Scope == SymbolScope::Function ||
+      Found.Scope == SymbolScope::TranslationUnit)
+    return 0;
+
+  std::vector<TranslationUnit> TUs;
+  if ((Options.Dependents || Found.Scope == SymbolScope::File) && DepDB) {
+    const std::vector<StringRef> DeclarationFiles(
+        Found.DeclarationFiles.begin(), Found.DeclarationFiles.end());
+    const auto Entries = DepDB->getEntries(DeclarationFiles);
+    if (Entries.any())
+      TUs = getTranslationUnits(*DepDB, Entries);
+    else
+      errs() << "clang-rename: " << PrevName << " is not declared in the "
+             << "dependency database, renaming in the given files only.\n";
+  }
+  if (TUs.empty()) {
+    TUs = getTranslationUnits(Compilations, Files);
+    // Without a database, a symbol declared only in the origin's source file
+    // can only be in the translation units compiling that file.
+    if (Found.Scope == SymbolScope::File &&
+        Found.DeclarationFiles.size() == 1 &&
+        Found.DeclarationFiles[0] == getCanonicalPath(Found.MainFile)) {
+      auto CompilesOther = [&Found](const TranslationUnit &TU) {
+        return TU.MainFile != Found.MainFile;
+      };
+      TUs.erase(std::remove_if(TUs.begin(), TUs.end(), CompilesOther),
+                TUs.end());
+    }
+  }
+
+  auto IsOrigin = [&Found](const TranslationUnit &TU) {
+    return TU.Command.Directory == Found.Command.Directory &&
+           TU.Command.CommandLine == Found.Command.CommandLine;
+  };
+  TUs.erase(std::remove_if(TUs.begin(), TUs.end(), IsOrigin), TUs.end());
+
+  if (Options.LexicalFilter && DepDB) {
+    PhaseTimer Timer("lexical filter");
+    TUs = filterTranslationUnits(TUs, PrevName, *DepDB);
+  }
+
+  std::unique_ptr<TranslationUnitTimes> Times;
+  if (!Options.TimesPath.empty())
+    Times.reset(new TranslationUnitTimes(Options.TimesPath));
+  CollectedHeaders Collected;
+  CollectedHeaders *Headers = Options.DedupHeaders ? &Collected : nullptr;
+  const unsigned NumWorkers = getNumWorkers(Options.Jobs, TUs.size());
+  int Result;
+  PhaseTimer Timer("rename in translation units");
+  if (Options.Isolate)
+    Result = renameInWorkerProcesses(TUs, NumWorkers, Options, PrevName, USRs,
+                                     Times.get(), Headers, Replaces);
+  else
+    Result = renameInWorkerThreads(TUs, NumWorkers, Options, PrevName, USRs,
+                                   Times.get(), Headers, Replaces);
+
+  std::string ErrorMessage;
+  if (Times && !Times->save(ErrorMessage))
+    errs() << "clang-rename: " << ErrorMessage << "\n";
+  return Result;
+}
+
+int applyReplacements(const tooling::Replacements &Replaces, bool Inplace,
+                      ArrayRef<std::string> Files, raw_ostream &OS) {
+  LangOptions DefaultLangOptions;
+  IntrusiveRefCntPtr<DiagnosticOptions> DiagOpts =
+      new DiagnosticOptions();
+  TextDiagnosticPrinter DiagnosticPrinter(errs(), &*DiagOpts);
+  DiagnosticsEngine Diagnostics(
+      IntrusiveRefCntPtr<DiagnosticIDs>(new DiagnosticIDs()),
+      &*DiagOpts, &DiagnosticPrinter, false);
+  FileManager FileMgr((FileSystemOptions()));
+  SourceManager Sources(Diagnostics, FileMgr);
+  Rewriter Rewrite(Sources, DefaultLangOptions);
+
+  {
+    PhaseTimer Timer("apply replacements");
+    getStatistics().Replacements += Replaces.size();
+    if (!tooling::applyAllReplacements(Replaces, Rewrite))
+      errs() << "Skipped some replacements.\n";
+  }
+
+  PhaseTimer Timer("write files");
+  if (Inplace) {
+    for (auto I = Rewrite.buffer_begin(), E = Rewrite.buffer_end(); I != E;
+         ++I)
+      getStatistics().BytesWritten += I->second.size();
+    return Rewrite.overwriteChangedFiles() ? 1 : 0;
+  }
+
+  // Write every file to OS. Right now we just barf the files without any
+  // indication of which files start where, other than that we print the files
+  // in the same order we see them.
+  for (const auto &File : Files) {
+    const auto *Entry = FileMgr.getFile(File);
+    if (!Entry)
+      continue;
+    auto ID = Sources.translateFile(Entry);
+    if (ID.isInvalid())
+      ID = Sources.createFileID(Entry, SourceLocation(), SrcMgr::C_User);
+    const auto &Buffer = Rewrite.getEditBuffer(ID);
+    getStatistics().BytesWritten += Buffer.size();
+    Buffer.write(OS);
+  }
+  return 0;
+}
+
+} // namespace rename
+} // namespace clang
@@ -0,0 +1,112 @@
+//===--- tools/extra/clang-rename/RenameDriver.h - Clang rename tool ------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief The steps of a rename, shared by the command line tool and the
+/// server.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_RENAME_DRIVER_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_RENAME_DRIVER_H
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/Refactoring.h"
+#include "llvm/ADT/ArrayRef.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+}
+
+namespace clang {
+namespace rename {
+
+class SymbolIndex;
+
+struct RenameOptions {
+  RenameOptions()
+      : Offset(0), Jobs(1), LexicalFilter(true), Dependents(false),
+        PrintName(false), PrintLocations(false), DedupHeaders(false),
+        MaxMemory(0),
+        Isolate(false), Timeout(0), Retries(1), Index(nullptr) {
+  }
+
+  std::string NewName;
+  // The offset of the symbol in the first file.
+  unsigned Offset;
+  // Translation units to parse in parallel, 0 for one per hardware thread.
+  unsigned Jobs;
+  // Skip translation units that cannot spell the symbol, see LexicalFilter.h.
+  bool LexicalFilter;
+  // Rename in every translation unit that can see a declaration of the
+  // symbol, as the dependency database tells, instead of in those of the
+  // given files. Always done for symbols without external linkage.
+  bool Dependents;
+  bool PrintName;
+  bool PrintLocations;
+  // Files and directories not to rename in, along with the system headers,
+  // see FileFilter.h.
+  std::vector<std::string> ExcludedPaths;
+  // Search a header once per state of the preprocessor it is parsed in,
+  // rather than in every translation unit, see HeaderFingerprint.h. Only
+  // sound for self-contained headers.
+  bool DedupHeaders;
+  // If set, the file the times of the translation units are kept in to
+  // schedule them by, see TranslationUnitTimes.h.
+  std::string TimesPath;
+  // If not 0, the bytes the ASTs parsed at the same time may take, see
+  // runOnTranslationUnits.
+  uint64_t MaxMemory;
+  // Parse in forked worker processes, so that a crash or a hang only loses
+  // the translation unit it happened in.
+  bool Isolate;
+  // With Isolate, the seconds a translation unit may take, 0 for no limit,
+  // and how often one whose worker was lost is tried again.
+  unsigned Timeout;
+  unsigned Retries;
+  // If set, tried before parsing.
+  const SymbolIndex *Index;
+};
+
+// Finds the symbol at Options.Offset in File and its USRs. Sets PrevName
+// to its spelling, or leaves it empty if there is no symbol there, in which
+// case an error has been printed.
+void findUSRs(const tooling::CompilationDatabase &Compilations,
+              llvm::StringRef File, const RenameOptions &Options,
+              std::vector<std::string> &USRs, std::string &PrevName);
+
+// Collects the replacements renaming the symbol at Options.Offset in Files[0]
+// to Options.NewName in every translation unit of Files, or of the files
+// declaring the symbol with Options.Dependents, and sets PrevName as findUSRs
+// does. Translation units that cannot refer to the symbol are skipped, see
+// SymbolScope.
+//
+// Returns 0 on success and 1 if any translation unit failed, like
+// ClangTool::run.
+int collectReplacements(const tooling::CompilationDatabase &Compilations,
+                        llvm::ArrayRef<std::string> Files,
+                        const RenameOptions &Options,
+                        tooling::Replacements &Replaces,
+                        std::string &PrevName);
+
+// Applies Replaces to the files as they are on disk now. If Inplace is set,
+// the edited files are overwritten; otherwise the edited contents of Files are
+// written to OS, in order.
+//
+// Returns 0 on success and 1 if a file could not be written.
+int applyReplacements(const tooling::Replacements &Replaces, bool Inplace,
+                      llvm::ArrayRef<std::string> Files, llvm::raw_ostream &OS);
+
+}
+}
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_RENAME_DRIVER_H
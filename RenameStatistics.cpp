@@ -0,0 +1,234 @@
+//===--- tools/extra/clang-rename/RenameStatistics.cpp - Clang rename tool ===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Process-wide counters and phase timings of the rename tool, printed
+/// with -stats and written with -time-trace.
+///
+/// Phases are few and coarse, a handful per translation unit at most, so they
+/// are always timed and kept in a list behind a lock.
+///
+//===----------------------------------------------------------------------===//
+
+#include "RenameStatistics.h"
+#include "JSONWriter.h"
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace llvm;
+
+namespace clang {
+namespace rename {
+
+RenameStatistics &getStatistics() {
+  static RenameStatistics Stats{};
+  return Stats;
+}
+
+namespace {
+// A phase that ended. Times are in microseconds since the process started
+// timing, memory in kilobytes.
+struct PhaseRecord {
+  std::string Name;
+  std::string Detail;
+  unsigned Thread;
+  uint64_t Start;
+  uint64_t Wall;
+  uint64_t CPU;
+  uint64_t MaxRSS;
+};
+
+struct PhaseLog {
+  std::mutex Mutex;
+  std::vector<PhaseRecord> Records;
+};
+} // namespace
+
+static PhaseLog &getPhaseLog() {
+  static PhaseLog Log;
+  return Log;
+}
+
+static uint64_t getWallTime() {
+  static const auto Origin = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - Origin).count();
+}
+
+static uint64_t getThreadCPUTime() {
+  timespec Time;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &Time))
+    return 0;
+  return uint64_t(Time.tv_sec) * 1000000 + Time.tv_nsec / 1000;
+}
+
+static uint64_t getMaxRSS() {
+  rusage Usage;
+  if (getrusage(RUSAGE_SELF, &Usage))
+    return 0;
+  return Usage.ru_maxrss;
+}
+
+// Numbers the threads in the order they first end a phase.
+static unsigned getThreadNumber() {
+  static std::atomic<unsigned> NextThread(0);
+  static LLVM_THREAD_LOCAL unsigned Thread;
+  static LLVM_THREAD_LOCAL bool Numbered;
+  if (!Numbered) {
+    Thread = NextThread++;
+    Numbered = true;
+  }
+  return Thread;
+}
+
+PhaseTimer::PhaseTimer(StringRef Name, StringRef Detail)
+    : Name(Name), Detail(Detail), WallStart(getWallTime()),
+      CPUStart(getThreadCPUTime()) {
+}
+
+PhaseTimer::~PhaseTimer() {
+  PhaseRecord Record;
+  Record.Name = std::move(Name);
+  Record.Detail = std::move(Detail);
+  Record.Thread = getThreadNumber();
+  Record.Start = WallStart;
+  Record.Wall = getWallTime() - WallStart;
+  Record.CPU = getThreadCPUTime() - CPUStart;
+  Record.MaxRSS = getMaxRSS();
+
+  auto &Log = getPhaseLog();
+  std::lock_guard<std::mutex> Lock(Log.Mutex);
+  Log.Records.push_back(std::move(Record));
+}
+
+static void printCounter(raw_ostream &OS, uint64_t Value, const char *Desc) {
+  OS << format("%12llu", (unsigned long long)Value) << " clang-rename - "
+     << Desc << "\n";
+}
+
+void printStatistics(raw_ostream &OS) {
+  const auto &Stats = getStatistics();
+  const uint64_t Hits = Stats.USRCacheHits;
+  const uint64_t Misses = Stats.USRCacheMisses;
+
+  OS << "===" << std::string(73, '-') << "===\n"
+     << "                    ... Statistics Collected ...\n"
+     << "===" << std::string(73, '-') << "===\n\n";
+  printCounter(OS, Hits, "Number of USR cache hits");
+  printCounter(OS, Misses, "Number of USRs generated");
+  printCounter(OS, Stats.NodesVisited, "Number of AST nodes visited");
+  printCounter(OS, Stats.DeclsSkipped,
+               "Number of declarations skipped in files ruled out");
+  printCounter(OS, Stats.HeadersShared,
+               "Number of headers searched in another translation unit");
+  printCounter(OS, Stats.Replacements, "Number of replacements");
+  printCounter(OS, Stats.BytesWritten, "Number of bytes written");
+  if (Hits + Misses)
+    OS << format("%12.1f", 100.0 * Hits / (Hits + Misses))
+       << " clang-rename - USR cache hit rate (%)\n";
+  printCounter(OS, Stats.UntimedTUs,
+               "Number of translation units scheduled without history");
+  printCounter(OS, Stats.MemoryWaits,
+               "Number of translation units that waited for memory");
+  printCounter(OS, Stats.WorkerCrashes,
+               "Number of worker processes lost to crashes or timeouts");
+  if (Stats.ActualMakespan) {
+    OS << format("%12.3f", Stats.PredictedMakespan / 1e6)
+       << " clang-rename - Predicted makespan (s)\n"
+       << format("%12.3f", Stats.ActualMakespan / 1e6)
+       << " clang-rename - Actual makespan (s)\n";
+  }
+  OS << "\n";
+
+  auto &Log = getPhaseLog();
+  std::lock_guard<std::mutex> Lock(Log.Mutex);
+  if (Log.Records.empty()) {
+    OS.flush();
+    return;
+  }
+
+  struct PhaseTotal {
+    unsigned Count;
+    uint64_t Wall;
+    uint64_t CPU;
+    uint64_t MaxRSS;
+  };
+  std::map<std::string, PhaseTotal> Totals;
+  for (const auto &Record : Log.Records) {
+    auto &Total = Totals[Record.Name];
+    ++Total.Count;
+    Total.Wall += Record.Wall;
+    Total.CPU += Record.CPU;
+    Total.MaxRSS = std::max(Total.MaxRSS, Record.MaxRSS);
+  }
+  OS << "===" << std::string(73, '-') << "===\n"
+     << "                      ... Phases, summed over threads ...\n"
+     << "===" << std::string(73, '-') << "===\n\n"
+     << "   Count    Wall (s)     CPU (s)  Peak RSS (MB)  Phase\n";
+  for (const auto &Total : Totals)
+    OS << format("%8u  %10.3f  %10.3f  %13.1f  ", Total.second.Count,
+                 Total.second.Wall / 1e6, Total.second.CPU / 1e6,
+                 Total.second.MaxRSS / 1024.0)
+       << Total.first << "\n";
+
+  // The translation units that took longest, parsing included.
+  std::vector<const PhaseRecord *> Slowest;
+  for (const auto &Record : Log.Records)
+    if (Record.Name == "translation unit")
+      Slowest.push_back(&Record);
+  const size_t NumShown = std::min<size_t>(Slowest.size(), 10);
+  std::partial_sort(Slowest.begin(), Slowest.begin() + NumShown,
+                    Slowest.end(),
+                    [](const PhaseRecord *A, const PhaseRecord *B) {
+                      return A->Wall > B->Wall;
+                    });
+  if (NumShown) {
+    OS << "\n    Wall (s)     CPU (s)  Peak RSS (MB)  Translation unit\n";
+    for (size_t I = 0; I != NumShown; ++I)
+      OS << format("  %10.3f  %10.3f  %13.1f  ", Slowest[I]->Wall / 1e6,
+                   Slowest[I]->CPU / 1e6, Slowest[I]->MaxRSS / 1024.0)
+         << Slowest[I]->Detail << "\n";
+  }
+  OS << "\n";
+  OS.flush();
+}
+
+void writeTimeTrace(raw_ostream &OS) {
+  auto &Log = getPhaseLog();
+  std::lock_guard<std::mutex> Lock(Log.Mutex);
+  const int Pid = ::getpid();
+  OS << "{\"traceEvents\": [";
+  for (size_t I = 0, E = Log.Records.size(); I != E; ++I) {
+    const auto &Record = Log.Records[I];
+    OS << (I ? ",\n" : "\n") << "{\"ph\": \"X\", \"cat\": \"clang-rename\", "
+       << "\"name\": ";
+    writeJSONString(OS, Record.Name);
+    OS << ", \"pid\": " << Pid << ", \"tid\": " << Record.Thread
+       << ", \"ts\": " << Record.Start << ", \"dur\": " << Record.Wall
+       << ", \"args\": {\"detail\": ";
+    writeJSONString(OS, Record.Detail);
+    OS << ", \"cpu_us\": " << Record.CPU << ", \"max_rss_kb\": "
+       << Record.MaxRSS << "}}";
+  }
+  OS << "\n], \"displayTimeUnit\": \"ms\"}\n";
+  OS.flush();
+}
+
+}
+}
@@ -0,0 +1,92 @@
+//===--- tools/extra/clang-rename/RenameStatistics.h - Clang rename tool --===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Process-wide counters and phase timings of the rename tool, printed
+/// with -stats and written with -time-trace.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_RENAME_STATISTICS_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_RENAME_STATISTICS_H
+
+#include "llvm/ADT/StringRef.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace llvm {
+class raw_ostream;
+}
+
+namespace clang {
+namespace rename {
+
+// Counters are updated from every worker thread, hence atomic.
+struct RenameStatistics {
+  std::atomic<uint64_t> USRCacheHits;
+  std::atomic<uint64_t> USRCacheMisses;
+  // AST nodes the occurrence finder visited.
+  std::atomic<uint64_t> NodesVisited;
+  // Declarations it skipped in files ruled out, see FileFilter.h.
+  std::atomic<uint64_t> DeclsSkipped;
+  // Headers not searched again, as another translation unit parsed them the
+  // same way, see HeaderFingerprint.h.
+  std::atomic<uint64_t> HeadersShared;
+  // Replacements applied, and bytes of the edited files written.
+  std::atomic<uint64_t> Replacements;
+  std::atomic<uint64_t> BytesWritten;
+  // Translation units scheduled without a recorded time, see
+  // TranslationUnitTimes.h.
+  std::atomic<uint64_t> UntimedTUs;
+  // The longest worker queue as scheduled, and the time the workers took,
+  // summed over the parallel passes, in microseconds.
+  std::atomic<uint64_t> PredictedMakespan;
+  std::atomic<uint64_t> ActualMakespan;
+  // Translation units that waited for memory, see -max-memory.
+  std::atomic<uint64_t> MemoryWaits;
+  // Worker processes that crashed or were killed, see -isolate.
+  std::atomic<uint64_t> WorkerCrashes;
+};
+
+// Returns the counters of this process.
+RenameStatistics &getStatistics();
+
+// Times a phase of the rename, from its construction to its destruction:
+// wall and CPU time of the calling thread, and the peak memory of the process
+// at the end. Detail tells apart the instances of a phase, e.g. the
+// translation units it was run on. Phases may nest and run on any thread.
+class PhaseTimer {
+public:
+  explicit PhaseTimer(llvm::StringRef Name,
+                      llvm::StringRef Detail = llvm::StringRef());
+  ~PhaseTimer();
+
+private:
+  PhaseTimer(const PhaseTimer &) = delete;
+  void operator=(const PhaseTimer &) = delete;
+
+  std::string Name;
+  std::string Detail;
+  uint64_t WallStart;
+  uint64_t CPUStart;
+};
+
+// Prints the counters in the format of llvm::PrintStatistics, followed by
+// the time spent in each phase and the slowest translation units.
+void printStatistics(llvm::raw_ostream &OS);
+
+// Writes the phases timed so far as Chrome trace events, for
+// chrome://tracing or Perfetto.
+void writeTimeTrace(llvm::raw_ostream &OS);
+
+}
+}
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_RENAME_STATISTICS_H
@@ -13,6 +13,11 @@
 //===----------------------------------------------------------------------===//
 
 #include "RenamingAction.h"
+#include "FileFilter.h"
+#include "HeaderFingerprint.h"
+#include "ParallelRunner.h"
+#include "RenameStatistics.h"
+#include "USRFinder.h"
 #include "USRLocFinder.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/ASTContext.h"
@@ -24,6 +29,10 @@
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/Refactoring.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
@@ -35,55 +44,135 @@ using namespace llvm;
 namespace clang {
 namespace rename {
 
+// Removes "." and ".." components from an absolute path.
+static void removeDots(SmallVectorImpl<char> &Path) {
+  SmallVector<StringRef, 16> Components;
+  StringRef Str(Path.data(), Path.size());
+  for (auto I = sys::path::begin(Str), E = sys::path::end(Str); I != E; ++I) {
+    if (*I == ".")
+      continue;
+    if (*I == "..") {
+      if (Components.size() > 1)
+        Components.pop_back();
+      continue;
+    }
+    Components.push_back(*I);
+  }
+
+  SmallString<256> Result;
+  for (const auto &Component : Components)
+    sys::path::append(Result, Component);
+  Path.swap(Result);
+}
+
+std::string getCanonicalPath(StringRef Path) {
+  SmallString<256> Result(Path);
+  sys::fs::make_absolute(Result);
+  removeDots(Result);
+  return Result.str();
+}
+
+std::string getCanonicalPath(const SourceManager &SourceMgr, FileID ID) {
+  const auto *Entry = SourceMgr.getFileEntryForID(ID);
+  if (!Entry)
+    return std::string();
+
+  SmallString<256> Path(Entry->getName());
+  SourceMgr.getFileManager().FixupRelativePath(Path);
+  return getCanonicalPath(Path);
+}
+
+// Creates a replacement for Loc keyed by its file's canonical path.
+static tooling::Replacement makeReplacement(const SourceManager &SourceMgr,
+                                            SourceLocation Loc, unsigned Length,
+                                            StringRef NewName) {
+  const auto DecomposedLoc = SourceMgr.getDecomposedLoc(Loc);
+  const auto Path = getCanonicalPath(SourceMgr, DecomposedLoc.first);
+  if (Path.empty())
+    return tooling::Replacement(SourceMgr, Loc, Length, NewName);
+  return tooling::Replacement(Path, DecomposedLoc.second, Length, NewName);
+}
+
+void RenamingAction::renameIn(ASTContext &Context, USRCache &Cache,
+                              Decl *Scope) {
+  const auto &SourceMgr = Context.getSourceManager();
+  const auto *MainFile = SourceMgr.getFileEntryForID(SourceMgr.getMainFileID());
+  PhaseTimer Timer("find occurrences", MainFile ? MainFile->getName() : "");
+  std::vector<SourceLocation> RenamingCandidates;
+  if (Scope) {
+    RenamingCandidates = getLocationsOfUSRs(USRs, PrevName, Scope, Cache);
+  } else {
+    // Skip the headers another translation unit searched already, and have
+    // the others skipped from now on.
+    std::vector<FileID> Collected;
+    std::vector<uint64_t> Searched;
+    if (Headers && Fingerprinter) {
+      std::vector<std::pair<FileID, uint64_t>> Fingerprints;
+      Fingerprinter->getFingerprints(Fingerprints);
+      for (const auto &Fingerprint : Fingerprints) {
+        if (Headers->contains(Fingerprint.second))
+          Collected.push_back(Fingerprint.first);
+        else
+          Searched.push_back(Fingerprint.second);
+      }
+      getStatistics().HeadersShared += Collected.size();
+    }
+    const FileFilter Filter(SourceMgr, PrevName, ExcludedPaths, Collected);
+    RenamingCandidates = getLocationsOfUSRs(
+        USRs, PrevName, Context.getTranslationUnitDecl(), Cache, &Filter);
+    if (Headers)
+      Headers->insert(Searched);
+  }
+
+  auto PrevNameLen = PrevName.length();
+  if (PrintLocations) {
+    // Other translation units may be renamed in on other threads.
+    std::string Locations;
+    raw_string_ostream OS(Locations);
+    for (const auto &Loc : RenamingCandidates) {
+      FullSourceLoc FullLoc(Loc, SourceMgr);
+      OS << "clang-rename: renamed at: " << SourceMgr.getFilename(Loc) << ":"
+         << FullLoc.getSpellingLineNumber() << ":"
+         << FullLoc.getSpellingColumnNumber() << "\n";
+      Replaces.insert(makeReplacement(SourceMgr, Loc, PrevNameLen, NewName));
+    }
+    printFromWorker(OS.str());
+  } else {
+    for (const auto &Loc : RenamingCandidates)
+      Replaces.insert(makeReplacement(SourceMgr, Loc, PrevNameLen, NewName));
+  }
+}
+
 class RenamingASTConsumer : public ASTConsumer {
 public:
-  RenamingASTConsumer(const std::string &NewName,
-                      const std::string &PrevName,
-                      const std::vector<std::string> &USRs,
-                      tooling::Replacements &Replaces,
-                      bool PrintLocations)
-      : NewName(NewName), PrevName(PrevName), USRs(USRs), Replaces(Replaces),
-        PrintLocations(PrintLocations) {
+  explicit RenamingASTConsumer(RenamingAction &Action) : Action(Action) {
   }
 
   void HandleTranslationUnit(ASTContext &Context) override {
-    const auto &SourceMgr = Context.getSourceManager();
-    std::vector<SourceLocation> RenamingCandidates;
-    std::vector<SourceLocation> NewCandidates;
-
-    for (const auto &USR : USRs) {
-      NewCandidates = getLocationsOfUSR(USR, Context.getTranslationUnitDecl());
-      RenamingCandidates.insert(RenamingCandidates.end(), NewCandidates.begin(),
-                                NewCandidates.end());
-      NewCandidates.clear();
-    }
-
-    auto PrevNameLen = PrevName.length();
-    if (PrintLocations)
-      for (const auto &Loc : RenamingCandidates) {
-        FullSourceLoc FullLoc(Loc, SourceMgr);
-        errs() << "clang-rename: renamed at: " << SourceMgr.getFilename(Loc)
-               << ":" << FullLoc.getSpellingLineNumber() << ":"
-               << FullLoc.getSpellingColumnNumber() << "\n";
-        Replaces.insert(tooling::Replacement(SourceMgr, Loc, PrevNameLen,
-                                             NewName));
-      }
-    else
-      for (const auto &Loc : RenamingCandidates)
-        Replaces.insert(tooling::Replacement(SourceMgr, Loc, PrevNameLen,
-                                             NewName));
+    USRCache Cache;
+    Action.renameIn(Context, Cache);
+    reportASTMemory(Context);
   }
 
 private:
-  const std::string &NewName, &PrevName;
-  const std::vector<std::string> &USRs;
-  tooling::Replacements &Replaces;
-  bool PrintLocations;
+  RenamingAction &Action;
 };
 
 std::unique_ptr<ASTConsumer> RenamingAction::newASTConsumer() {
-  return llvm::make_unique<RenamingASTConsumer>(NewName, PrevName, USRs,
-                                                Replaces, PrintLocations);
+  return llvm::make_unique<RenamingASTConsumer>(*this);
+}
+
+bool RenamingAction::handleBeginSource(CompilerInstance &CI,
+                                       StringRef Filename) {
+  if (Headers) {
+    Fingerprinter = new HeaderFingerprinter(CI);
+    CI.getPreprocessor().addPPCallbacks(Fingerprinter);
+  }
+  return true;
+}
+
+void RenamingAction::handleEndSource() {
+  Fingerprinter = nullptr;
 }
 
 }
@@ -16,29 +16,74 @@
 #define LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_RENAMING_ACTION_H_
 
 #include "clang/Tooling/Refactoring.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/StringRef.h"
+#include <string>
 
 namespace clang {
 class ASTConsumer;
+class ASTContext;
 class CompilerInstance;
+class FileID;
+class SourceManager;
 
 namespace rename {
 
-class RenamingAction {
+class CollectedHeaders;
+class HeaderFingerprinter;
+class USRCache;
+
+// Returns Path made absolute against the working directory, without "." and
+// ".." components. Replacements refer to files by such paths: translation
+// units reach the same header through different compile directories and
+// include paths, and only one entry per file may be left once replacements
+// of several translation units are merged.
+std::string getCanonicalPath(llvm::StringRef Path);
+
+// Returns the canonical path of the file with the given ID, or an empty
+// string if ID is not a file.
+std::string getCanonicalPath(const SourceManager &SourceMgr, FileID ID);
+
+// Makes the consumers that collect the replacements in each translation unit
+// parsed. As the source file callbacks of the parse, it fingerprints the
+// headers of the translation unit for them.
+class RenamingAction : public tooling::SourceFileCallbacks {
 public:
+  // Files under ExcludedPaths are not searched, see FileFilter. With Headers,
+  // headers another translation unit collected the occurrences of, as shared
+  // through Headers, are not searched either.
   RenamingAction(const std::string &NewName, const std::string &PrevName,
                  const std::vector<std::string> &USRs,
-                 tooling::Replacements &Replaces, bool PrintLocations = false)
-      : NewName(NewName), PrevName(PrevName), USRs(USRs), Replaces(Replaces),
-        PrintLocations(PrintLocations) {
+                 const std::vector<std::string> &ExcludedPaths,
+                 tooling::Replacements &Replaces, bool PrintLocations = false,
+                 CollectedHeaders *Headers = nullptr)
+      : NewName(NewName), PrevName(PrevName), USRs(USRs),
+        ExcludedPaths(ExcludedPaths), Replaces(Replaces),
+        PrintLocations(PrintLocations), Headers(Headers),
+        Fingerprinter(nullptr) {
   }
 
   std::unique_ptr<ASTConsumer> newASTConsumer();
 
+  bool handleBeginSource(CompilerInstance &CI,
+                         llvm::StringRef Filename) override;
+  void handleEndSource() override;
+
+  // Collects the replacements in a translation unit that is already parsed,
+  // e.g. the one the USRs were found in, whose USRs Cache may hold already.
+  // Only Scope is searched if given, e.g. the function a local is declared
+  // in; otherwise files that cannot hold occurrences are skipped.
+  void renameIn(ASTContext &Context, USRCache &Cache, Decl *Scope = nullptr);
+
 private:
   const std::string &NewName, &PrevName;
   const std::vector<std::string> &USRs;
+  const std::vector<std::string> &ExcludedPaths;
   tooling::Replacements &Replaces;
   bool PrintLocations;
+  CollectedHeaders *Headers;
+  // Of the translation unit being parsed, owned by its preprocessor.
+  HeaderFingerprinter *Fingerprinter;
 };
 
 }
@@ -0,0 +1,46 @@
+//===--- tools/extra/clang-rename/StableHash.h - Clang rename tool --------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief A 64-bit hash that, unlike llvm::hash_value, is the same in every
+/// run and process, for what is written to disk or sent between workers.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_STABLE_HASH_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_STABLE_HASH_H
+
+#include "llvm/ADT/StringRef.h"
+#include <cstdint>
+
+namespace clang {
+namespace rename {
+
+// The hash of no bytes at all, to start from.
+const uint64_t EmptyStableHash = 14695981039346656037ULL;
+
+// Continues Hash, 64-bit FNV-1a, with Bytes.
+inline uint64_t hashBytes(llvm::StringRef Bytes,
+                          uint64_t Hash = EmptyStableHash) {
+  for (unsigned char C : Bytes)
+    Hash = (Hash ^ C) * 1099511628211ULL;
+  return Hash;
+}
+
+// Continues Hash with the eight bytes of Value, least significant first.
+inline uint64_t hashWord(uint64_t Value, uint64_t Hash = EmptyStableHash) {
+  for (unsigned I = 0; I != 8; ++I)
+    Hash = (Hash ^ ((Value >> (8 * I)) & 0xff)) * 1099511628211ULL;
+  return Hash;
+}
+
+}
+}
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_STABLE_HASH_H
@@ -0,0 +1,815 @@
+//===--- tools/extra/clang-rename/SymbolIndex.cpp - Clang rename tool -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief A persistent index of the locations every USR is spelled at, which
+/// lets a rename skip parsing altogether.
+///
+/// The index file is a sequence of little-endian 32-bit words:
+///
+///   header:           magic, version, #files, #USRs, #occurrences, #TUs,
+///                     size of the string table
+///   files:            #files x (path, first file occurrence, hash, size,
+///                     modification time)
+///   USRs:             #USRs x (USR, first occurrence)
+///   occurrences:      #occurrences x (file, offset, length)
+///   file occurrences: #occurrences x (offset, length, USR)
+///   TUs:              #TUs x (main file, command hash)
+///
+/// followed by the NUL-terminated strings the tables refer to by offset.
+/// Hashes, sizes and times take two words, low word first. Files and USRs
+/// are sorted by their strings, occurrences are grouped by USR and file
+/// occurrences by file, both sorted by offset.
+///
+/// The file stamps and command hashes let clang-rename index update an
+/// existing index by reparsing only the translation units affected by a
+/// change.
+///
+//===----------------------------------------------------------------------===//
+
+#include "SymbolIndex.h"
+#include "RenamingAction.h"
+#include "StableHash.h"
+#include "USRFinder.h"
+#include "USRLocFinder.h"
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/Basic/SourceManager.h"
+#include "src/DependencyDatabase.h"
+#include "clang/Basic/FileManager.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+
+using namespace llvm;
+
+namespace clang {
+namespace rename {
+
+static const uint32_t IndexMagic = 0x58495243; // "CRIX"
+static const uint32_t IndexVersion = 2;
+static const unsigned HeaderSize = 7;
+static const unsigned FileRecordSize = 8;
+static const unsigned USRRecordSize = 2;
+static const unsigned OccurrenceRecordSize = 3;
+static const unsigned TURecordSize = 3;
+
+unsigned SymbolIndexBuilder::getFileID(StringRef File) {
+  auto &Entry = FileIDs.GetOrCreateValue(File, Files.size());
+  if (Entry.getValue() == Files.size()) {
+    Files.push_back(Entry.getKey());
+    FileStamp Unknown = { 0, 0, 0 };
+    Stamps.push_back(Unknown);
+  }
+  return Entry.getValue();
+}
+
+void SymbolIndexBuilder::addOccurrence(StringRef USR, StringRef File,
+                                       unsigned Offset, unsigned Length) {
+  Occurrence Occ = { getFileID(File), Offset, Length };
+  USRs[USR].insert(Occ);
+}
+
+void SymbolIndexBuilder::addFile(StringRef File, const FileStamp &Stamp) {
+  Stamps[getFileID(File)] = Stamp;
+}
+
+void SymbolIndexBuilder::addTranslationUnit(const TranslationUnit &TU) {
+  TranslationUnits.insert(std::make_pair(getCanonicalPath(TU.MainFile),
+                                         getCommandHash(TU.Command)));
+}
+
+void SymbolIndexBuilder::merge(const SymbolIndexBuilder &Other) {
+  std::vector<unsigned> FileMap;
+  for (unsigned I = 0, E = Other.Files.size(); I != E; ++I) {
+    FileMap.push_back(getFileID(Other.Files[I]));
+    if (Other.Stamps[I].Hash)
+      Stamps[FileMap.back()] = Other.Stamps[I];
+  }
+  TranslationUnits.insert(Other.TranslationUnits.begin(),
+                          Other.TranslationUnits.end());
+
+  for (const auto &Entry : Other.USRs) {
+    auto &Occurrences = USRs[Entry.getKey()];
+    for (auto Occ : Entry.getValue()) {
+      Occ.File = FileMap[Occ.File];
+      Occurrences.insert(Occ);
+    }
+  }
+}
+
+namespace {
+class IndexWriter {
+public:
+  explicit IndexWriter(raw_ostream &OS) : OS(OS) {
+  }
+
+  void write(uint32_t Word) {
+    const char Bytes[] = { char(Word), char(Word >> 8), char(Word >> 16),
+                           char(Word >> 24) };
+    OS.write(Bytes, sizeof(Bytes));
+  }
+
+  void write64(uint64_t Words) {
+    write(uint32_t(Words));
+    write(uint32_t(Words >> 32));
+  }
+
+  // Adds S to the string table and returns its offset.
+  uint32_t addString(StringRef S) {
+    const uint32_t Offset = Strings.size();
+    Strings.append(S.begin(), S.end());
+    Strings.push_back('\0');
+    return Offset;
+  }
+
+  const std::string &getStrings() const {
+    return Strings;
+  }
+
+private:
+  raw_ostream &OS;
+  std::string Strings;
+};
+} // namespace
+
+bool SymbolIndexBuilder::write(StringRef Path,
+                               std::string &ErrorMessage) const {
+  // Number files and USRs in sorted order so both can be binary searched.
+  std::vector<unsigned> FileOrder(Files.size());
+  for (unsigned I = 0, E = Files.size(); I != E; ++I)
+    FileOrder[I] = I;
+  std::sort(FileOrder.begin(), FileOrder.end(),
+            [this](unsigned L, unsigned R) { return Files[L] < Files[R]; });
+  std::vector<uint32_t> SortedFileID(Files.size());
+  for (unsigned I = 0, E = FileOrder.size(); I != E; ++I)
+    SortedFileID[FileOrder[I]] = I;
+
+  std::vector<const StringMapEntry<std::set<Occurrence>> *> SortedUSRs;
+  for (const auto &Entry : USRs)
+    SortedUSRs.push_back(&Entry);
+  std::sort(SortedUSRs.begin(), SortedUSRs.end(),
+            [](const StringMapEntry<std::set<Occurrence>> *L,
+               const StringMapEntry<std::set<Occurrence>> *R) {
+    return L->getKey() < R->getKey();
+  });
+
+  struct FileOccurrence {
+    uint32_t File, Offset, Length, USR;
+
+    bool operator<(const FileOccurrence &Other) const {
+      if (File != Other.File)
+        return File < Other.File;
+      return Offset < Other.Offset;
+    }
+  };
+  std::vector<FileOccurrence> ByFile;
+  for (unsigned I = 0, E = SortedUSRs.size(); I != E; ++I)
+    for (const auto &Occ : SortedUSRs[I]->getValue()) {
+      FileOccurrence FO = { SortedFileID[Occ.File], Occ.Offset, Occ.Length,
+                            I };
+      ByFile.push_back(FO);
+    }
+  std::sort(ByFile.begin(), ByFile.end());
+
+  // Write through a temporary file: the server and other renames may have the
+  // old index mapped, and it has to survive a failed write.
+  int FD;
+  SmallString<128> TempPath;
+  if (std::error_code EC =
+          sys::fs::createUniqueFile(Path + "-%%%%%%", FD, TempPath)) {
+    ErrorMessage = "Error while writing symbol index: " + EC.message();
+    return false;
+  }
+  raw_fd_ostream OS(FD, /*shouldClose=*/true);
+  IndexWriter Writer(OS);
+
+  std::vector<uint32_t> FilePaths, FileBegins, USRNames, USRBegins, TUFiles;
+  for (unsigned I = 0, Begin = 0, E = FileOrder.size(); I != E; ++I) {
+    FilePaths.push_back(Writer.addString(Files[FileOrder[I]]));
+    FileBegins.push_back(Begin);
+    while (Begin != ByFile.size() && ByFile[Begin].File == I)
+      ++Begin;
+  }
+  for (unsigned I = 0, Begin = 0, E = SortedUSRs.size(); I != E; ++I) {
+    USRNames.push_back(Writer.addString(SortedUSRs[I]->getKey()));
+    USRBegins.push_back(Begin);
+    Begin += SortedUSRs[I]->getValue().size();
+  }
+  for (const auto &TU : TranslationUnits)
+    TUFiles.push_back(Writer.addString(TU.first));
+
+  Writer.write(IndexMagic);
+  Writer.write(IndexVersion);
+  Writer.write(Files.size());
+  Writer.write(SortedUSRs.size());
+  Writer.write(ByFile.size());
+  Writer.write(TranslationUnits.size());
+  Writer.write(Writer.getStrings().size());
+
+  for (unsigned I = 0, E = FilePaths.size(); I != E; ++I) {
+    const auto &Stamp = Stamps[FileOrder[I]];
+    Writer.write(FilePaths[I]);
+    Writer.write(FileBegins[I]);
+    Writer.write64(Stamp.Hash);
+    Writer.write64(Stamp.Size);
+    Writer.write64(Stamp.ModificationTime);
+  }
+  for (unsigned I = 0, E = USRNames.size(); I != E; ++I) {
+    Writer.write(USRNames[I]);
+    Writer.write(USRBegins[I]);
+  }
+  for (const auto *Entry : SortedUSRs)
+    for (const auto &Occ : Entry->getValue()) {
+      Writer.write(SortedFileID[Occ.File]);
+      Writer.write(Occ.Offset);
+      Writer.write(Occ.Length);
+    }
+  for (const auto &FO : ByFile) {
+    Writer.write(FO.Offset);
+    Writer.write(FO.Length);
+    Writer.write(FO.USR);
+  }
+  unsigned TUIndex = 0;
+  for (const auto &TU : TranslationUnits) {
+    Writer.write(TUFiles[TUIndex++]);
+    Writer.write64(TU.second);
+  }
+  OS << Writer.getStrings();
+  OS.close();
+  if (OS.has_error()) {
+    OS.clear_error();
+    sys::fs::remove(TempPath.str());
+    ErrorMessage = "Error while writing symbol index.";
+    return false;
+  }
+  if (std::error_code EC = sys::fs::rename(TempPath.str(), Path)) {
+    sys::fs::remove(TempPath.str());
+    ErrorMessage = "Error while writing symbol index: " + EC.message();
+    return false;
+  }
+  return true;
+}
+
+namespace {
+// \brief Records every occurrence the USRLocFinder visitor reports.
+class IndexingHandler : public OccurrenceHandler {
+public:
+  IndexingHandler(const SourceManager &SourceMgr, SymbolIndexBuilder &Builder)
+      : SourceMgr(SourceMgr), Builder(Builder) {
+  }
+
+  void handleOccurrence(const NamedDecl *Decl, SourceLocation Loc) override {
+    if (!Loc.isValid() || !Loc.isFileID() || SourceMgr.isInSystemHeader(Loc))
+      return;
+
+    // Renaming finds destructors through the TypeLoc of their class, and
+    // renames constructors along with it.
+    if (isa<CXXDestructorDecl>(Decl))
+      return;
+    if (const auto *Ctor = dyn_cast<CXXConstructorDecl>(Decl))
+      Decl = Ctor->getParent();
+
+    // Only identifiers have a spelling of known length.
+    const auto *II = Decl->getIdentifier();
+    if (!II)
+      return;
+    const auto USR = Cache.getUSR(Decl);
+    if (USR.empty())
+      return;
+
+    const auto DecomposedLoc = SourceMgr.getDecomposedLoc(Loc);
+    const auto &Path = getPath(DecomposedLoc.first);
+    if (!Path.empty())
+      Builder.addOccurrence(USR, Path, DecomposedLoc.second, II->getLength());
+  }
+
+private:
+  const std::string &getPath(FileID ID) {
+    auto It = Paths.find(ID);
+    if (It == Paths.end())
+      It = Paths.insert(
+          std::make_pair(ID, getCanonicalPath(SourceMgr, ID))).first;
+    return It->second;
+  }
+
+  const SourceManager &SourceMgr;
+  SymbolIndexBuilder &Builder;
+  USRCache Cache;
+  DenseMap<FileID, std::string> Paths;
+};
+
+class IndexingASTConsumer : public ASTConsumer {
+public:
+  explicit IndexingASTConsumer(SymbolIndexBuilder &Builder)
+      : Builder(Builder) {
+  }
+
+  void HandleTranslationUnit(ASTContext &Context) override {
+    IndexingHandler Handler(Context.getSourceManager(), Builder);
+    forEachOccurrence(Context.getTranslationUnitDecl(), Handler);
+    addFiles(Context.getSourceManager());
+  }
+
+private:
+  // Records the contents of every user file the translation unit read, so
+  // that an update can tell whether it has to be reindexed.
+  void addFiles(const SourceManager &SourceMgr) {
+    SmallPtrSet<const SrcMgr::ContentCache *, 32> Seen;
+    for (unsigned I = 0, E = SourceMgr.local_sloc_entry_size(); I != E; ++I) {
+      const auto &Entry = SourceMgr.getLocalSLocEntry(I);
+      if (!Entry.isFile() ||
+          Entry.getFile().getFileCharacteristic() != SrcMgr::C_User)
+        continue;
+      const auto *Contents = Entry.getFile().getContentCache();
+      const auto *File = Contents->OrigEntry;
+      if (!File || !Contents->getRawBuffer() || !Seen.insert(Contents))
+        continue;
+
+      SmallString<256> Path(File->getName());
+      SourceMgr.getFileManager().FixupRelativePath(Path);
+      FileStamp Stamp = { hashBytes(Contents->getRawBuffer()->getBuffer()),
+                          uint64_t(File->getSize()),
+                          uint64_t(File->getModificationTime()) };
+      Builder.addFile(getCanonicalPath(Path), Stamp);
+    }
+  }
+
+  SymbolIndexBuilder &Builder;
+};
+} // namespace
+
+std::unique_ptr<ASTConsumer> IndexingAction::newASTConsumer() {
+  return llvm::make_unique<IndexingASTConsumer>(Builder);
+}
+
+std::unique_ptr<SymbolIndex>
+SymbolIndex::load(StringRef Path, std::string &ErrorMessage) {
+  auto Buffer = MemoryBuffer::getFile(Path, /*FileSize=*/-1,
+                                      /*RequiresNullTerminator=*/false);
+  if (std::error_code Result = Buffer.getError()) {
+    ErrorMessage = "Error while opening symbol index: " + Result.message();
+    return nullptr;
+  }
+  std::unique_ptr<SymbolIndex> Index(new SymbolIndex(std::move(*Buffer)));
+  if (!Index->parse(ErrorMessage))
+    return nullptr;
+  return Index;
+}
+
+bool SymbolIndex::parse(std::string &ErrorMessage) {
+  const char *Start = Buffer->getBufferStart();
+  const uint64_t Size = Buffer->getBufferSize();
+  const Word *Header = reinterpret_cast<const Word *>(Start);
+  if (Size < HeaderSize * sizeof(Word) || Header[0] != IndexMagic ||
+      Header[1] != IndexVersion) {
+    ErrorMessage = "Not a symbol index, or written by another version.";
+    return false;
+  }
+
+  NumFiles = Header[2];
+  NumUSRs = Header[3];
+  NumOccurrences = Header[4];
+  NumTUs = Header[5];
+  const uint64_t StringsSize = Header[6];
+
+  const uint64_t NumWords =
+      HeaderSize + uint64_t(NumFiles) * FileRecordSize +
+      uint64_t(NumUSRs) * USRRecordSize +
+      2 * uint64_t(NumOccurrences) * OccurrenceRecordSize +
+      uint64_t(NumTUs) * TURecordSize;
+  if (NumWords * sizeof(Word) + StringsSize != Size ||
+      (StringsSize && Start[Size - 1] != '\0')) {
+    ErrorMessage = "Truncated symbol index.";
+    return false;
+  }
+
+  FileTable = Header + HeaderSize;
+  USRTable = FileTable + uint64_t(NumFiles) * FileRecordSize;
+  Occurrences = USRTable + uint64_t(NumUSRs) * USRRecordSize;
+  FileOccurrences =
+      Occurrences + uint64_t(NumOccurrences) * OccurrenceRecordSize;
+  TUTable = FileOccurrences + uint64_t(NumOccurrences) * OccurrenceRecordSize;
+  Strings = reinterpret_cast<const char *>(
+      TUTable + uint64_t(NumTUs) * TURecordSize);
+
+  // Lookups follow the offsets and indices in the tables without checking
+  // them, so a corrupt index must be refused here. The string table ends
+  // with a NUL, so any offset into it is a terminated string.
+  auto HasBegins = [](const Word *Table, uint32_t Count, unsigned RecordSize,
+                     uint32_t Limit) {
+    uint32_t Previous = 0;
+    for (uint32_t I = 0; I != Count; ++I) {
+      const uint32_t Begin = Table[uint64_t(I) * RecordSize + 1];
+      if (Begin < Previous || Begin > Limit)
+        return false;
+      Previous = Begin;
+    }
+    return true;
+  };
+  auto HasStrings = [StringsSize](const Word *Table, uint32_t Count,
+                                  unsigned RecordSize) {
+    for (uint32_t I = 0; I != Count; ++I)
+      if (Table[uint64_t(I) * RecordSize] >= StringsSize)
+        return false;
+    return true;
+  };
+  auto HasIndices = [](const Word *Table, uint32_t Count, unsigned Field,
+                       uint32_t Limit) {
+    for (uint32_t I = 0; I != Count; ++I)
+      if (Table[uint64_t(I) * OccurrenceRecordSize + Field] >= Limit)
+        return false;
+    return true;
+  };
+  if (!HasStrings(FileTable, NumFiles, FileRecordSize) ||
+      !HasStrings(USRTable, NumUSRs, USRRecordSize) ||
+      !HasStrings(TUTable, NumTUs, TURecordSize) ||
+      !HasBegins(FileTable, NumFiles, FileRecordSize, NumOccurrences) ||
+      !HasBegins(USRTable, NumUSRs, USRRecordSize, NumOccurrences) ||
+      !HasIndices(Occurrences, NumOccurrences, 0, NumFiles) ||
+      !HasIndices(FileOccurrences, NumOccurrences, 2, NumUSRs)) {
+    ErrorMessage = "Corrupt symbol index.";
+    return false;
+  }
+  return true;
+}
+
+const SymbolIndex::Word *SymbolIndex::find(const Word *Table, uint32_t Count,
+                                           unsigned RecordSize,
+                                           StringRef Key) const {
+  uint32_t Low = 0, High = Count;
+  while (Low < High) {
+    const uint32_t Mid = Low + (High - Low) / 2;
+    const Word *Record = Table + uint64_t(Mid) * RecordSize;
+    const int Cmp = getString(Record[0]).compare(Key);
+    if (Cmp == 0)
+      return Record;
+    if (Cmp < 0)
+      Low = Mid + 1;
+    else
+      High = Mid;
+  }
+  return nullptr;
+}
+
+StringRef SymbolIndex::getUSRAt(StringRef File, unsigned Offset,
+                                SymbolOccurrence &Occurrence) const {
+  const Word *Record = find(FileTable, NumFiles, FileRecordSize, File);
+  if (!Record)
+    return StringRef();
+
+  const uint32_t Index = (Record - FileTable) / FileRecordSize;
+  uint32_t Begin = Record[1];
+
+  // Find the first occurrence starting after Offset; the one before it is
+  // the only one that can span Offset.
+  uint32_t End = Index + 1 == NumFiles ? NumOccurrences
+                                        : uint32_t(Record[FileRecordSize + 1]);
+  while (Begin < End) {
+    const uint32_t Mid = Begin + (End - Begin) / 2;
+    if (FileOccurrences[uint64_t(Mid) * OccurrenceRecordSize] <= Offset)
+      Begin = Mid + 1;
+    else
+      End = Mid;
+  }
+  if (Begin == uint32_t(Record[1]))
+    return StringRef();
+
+  const Word *Occ =
+      FileOccurrences + uint64_t(Begin - 1) * OccurrenceRecordSize;
+  if (Offset >= Occ[0] + Occ[1])
+    return StringRef();
+
+  Occurrence.File = getString(Record[0]);
+  Occurrence.Offset = Occ[0];
+  Occurrence.Length = Occ[1];
+  return getString(USRTable[uint64_t(Occ[2]) * USRRecordSize]);
+}
+
+std::vector<SymbolOccurrence>
+SymbolIndex::getOccurrences(StringRef USR) const {
+  std::vector<SymbolOccurrence> Result;
+  const Word *Record = find(USRTable, NumUSRs, USRRecordSize, USR);
+  if (!Record)
+    return Result;
+
+  const uint32_t Index = (Record - USRTable) / USRRecordSize;
+  const uint32_t Begin = Record[1];
+  const uint32_t End = Index + 1 == NumUSRs
+                           ? NumOccurrences
+                           : uint32_t(Record[USRRecordSize + 1]);
+  for (uint32_t I = Begin; I != End; ++I) {
+    const Word *Occ = Occurrences + uint64_t(I) * OccurrenceRecordSize;
+    SymbolOccurrence Occurrence;
+    Occurrence.File = getString(FileTable[uint64_t(Occ[0]) * FileRecordSize]);
+    Occurrence.Offset = Occ[1];
+    Occurrence.Length = Occ[2];
+    Result.push_back(Occurrence);
+  }
+  return Result;
+}
+
+// Returns whether File still has the contents Stamp describes, and updates
+// Stamp's size and time if only those changed.
+static bool isUpToDate(StringRef File, FileStamp &Stamp) {
+  sys::fs::file_status Status;
+  if (sys::fs::status(File, Status) || !sys::fs::is_regular_file(Status))
+    return false;
+  const uint64_t ModificationTime =
+      Status.getLastModificationTime().toEpochTime();
+  if (Status.getSize() == Stamp.Size &&
+      ModificationTime == Stamp.ModificationTime)
+    return true;
+
+  auto Contents = MemoryBuffer::getFile(File, /*FileSize=*/-1,
+                                        /*RequiresNullTerminator=*/false);
+  if (!Contents || hashBytes((*Contents)->getBuffer()) != Stamp.Hash)
+    return false;
+  Stamp.Size = Status.getSize();
+  Stamp.ModificationTime = ModificationTime;
+  return true;
+}
+
+bool SymbolIndex::isFileUpToDate(StringRef File) const {
+  const Word *Record = find(FileTable, NumFiles, FileRecordSize, File);
+  if (!Record)
+    return false;
+  FileStamp Stamp = getStamp(Record);
+  return rename::isUpToDate(File, Stamp);
+}
+
+bool SymbolIndex::isUpToDate(StringRef USR,
+                             const tooling::CompilationDatabase &Compilations,
+                             std::string &Stale) const {
+  // New translation units may add occurrences in new files.
+  if (CheckedCompilations != &Compilations) {
+    std::set<std::pair<std::string, uint64_t>> Indexed;
+    for (uint32_t I = 0; I != NumTUs; ++I) {
+      const Word *Record = TUTable + uint64_t(I) * TURecordSize;
+      Indexed.insert(
+          std::make_pair(getString(Record[0]).str(), get64(Record + 1)));
+    }
+    std::set<std::pair<std::string, uint64_t>> Current;
+    for (const auto &TU :
+         getTranslationUnits(Compilations, Compilations.getAllFiles())) {
+      auto Key = std::make_pair(getCanonicalPath(TU.MainFile),
+                                getCommandHash(TU.Command));
+      if (!Indexed.count(Key)) {
+        Stale = Key.first;
+        return false;
+      }
+      Current.insert(std::move(Key));
+    }
+    for (const auto &TU : Indexed) {
+      if (!Current.count(TU)) {
+        Stale = TU.first;
+        return false;
+      }
+    }
+    CheckedCompilations = &Compilations;
+  }
+
+  const auto *DepDB = DependencyDatabase::getLoaded();
+  if (DepDB != &Compilations) {
+    for (uint32_t I = 0; I != NumFiles; ++I) {
+      const Word *Record = FileTable + uint64_t(I) * FileRecordSize;
+      FileStamp Stamp = getStamp(Record);
+      if (!rename::isUpToDate(getString(Record[0]), Stamp)) {
+        Stale = getString(Record[0]);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Only the translation units that include a file USR is spelled in can
+  // refer to it, and only in the files they include.
+  StringSet<> OccurrenceFiles;
+  for (const auto &Occ : getOccurrences(USR))
+    OccurrenceFiles.insert(Occ.File);
+  std::vector<StringRef> Files;
+  for (const auto &Entry : OccurrenceFiles)
+    Files.push_back(Entry.getKey());
+
+  StringSet<> Checked;
+  auto IsFileUpToDate = [this, &Checked, &Stale](StringRef Path) {
+    const auto File = getCanonicalPath(Path);
+    if (Checked.count(File))
+      return true;
+    Checked.insert(File);
+    // Files that were not indexed are system headers, or were included
+    // anew by a file that changed since.
+    const Word *Record = find(FileTable, NumFiles, FileRecordSize, File);
+    if (!Record)
+      return true;
+    FileStamp Stamp = getStamp(Record);
+    if (rename::isUpToDate(File, Stamp))
+      return true;
+    Stale = File;
+    return false;
+  };
+  for (const auto &File : Files)
+    if (!IsFileUpToDate(File))
+      return false;
+  for (const auto &SourceFile :
+       DepDB->getSourceFiles(DepDB->getEntries(Files))) {
+    if (!IsFileUpToDate(SourceFile))
+      return false;
+    for (const auto &Dependency : DepDB->getDependencies(SourceFile))
+      if (!IsFileUpToDate(Dependency))
+        return false;
+  }
+  return true;
+}
+
+std::vector<TranslationUnit>
+SymbolIndexBuilder::addUpToDate(const SymbolIndex &Index,
+                                ArrayRef<TranslationUnit> TUs) {
+  // Files whose occurrences are out of date.
+  StringSet<> Changed;
+  std::vector<FileStamp> IndexStamps(Index.NumFiles);
+  for (uint32_t I = 0; I != Index.NumFiles; ++I) {
+    const auto *Record = Index.FileTable + uint64_t(I) * FileRecordSize;
+    auto &Stamp = IndexStamps[I];
+    Stamp = SymbolIndex::getStamp(Record);
+    if (!isUpToDate(Index.getString(Record[0]), Stamp))
+      Changed.insert(Index.getString(Record[0]));
+  }
+
+  // Translation units that are gone, or were compiled differently, take the
+  // occurrences in their main files with them.
+  std::set<std::pair<std::string, uint64_t>> Current;
+  StringSet<> MainFiles;
+  for (const auto &TU : TUs) {
+    const auto MainFile = getCanonicalPath(TU.MainFile);
+    MainFiles.insert(MainFile);
+    Current.insert(std::make_pair(MainFile, getCommandHash(TU.Command)));
+  }
+  std::set<std::pair<std::string, uint64_t>> Indexed;
+  bool Retargeted = false;
+  for (uint32_t I = 0; I != Index.NumTUs; ++I) {
+    const auto *Record = Index.TUTable + uint64_t(I) * TURecordSize;
+    auto TU = std::make_pair(Index.getString(Record[0]).str(),
+                             SymbolIndex::get64(Record + 1));
+    if (!Current.count(TU)) {
+      Changed.insert(TU.first);
+      Retargeted = true;
+    }
+    Indexed.insert(std::move(TU));
+  }
+
+  // Find the translation units the changed files are part of. Without the
+  // dependency database, only main files can be traced, and nothing tells
+  // which headers a translation unit that is gone or compiled differently
+  // left occurrences in.
+  const auto *DepDB = DependencyDatabase::getLoaded();
+  bool ReindexAll = Retargeted && !DepDB;
+  StringSet<> Invalidated;
+  std::vector<StringRef> ChangedFiles;
+  for (const auto &Entry : Changed) {
+    Invalidated.insert(Entry.getKey());
+    ChangedFiles.push_back(Entry.getKey());
+    if (!DepDB)
+      ReindexAll |= !MainFiles.count(Entry.getKey());
+  }
+  if (DepDB)
+    for (const auto &SourceFile :
+         DepDB->getSourceFiles(DepDB->getEntries(ChangedFiles)))
+      Invalidated.insert(getCanonicalPath(SourceFile));
+
+  std::vector<TranslationUnit> Outdated;
+  StringSet<> Kept;
+  for (const auto &TU : TUs) {
+    auto Key = std::make_pair(getCanonicalPath(TU.MainFile),
+                              getCommandHash(TU.Command));
+    if (ReindexAll || !Indexed.count(Key) || Invalidated.count(Key.first)) {
+      Outdated.push_back(TU);
+    } else {
+      Kept.insert(Key.first);
+      TranslationUnits.insert(std::move(Key));
+    }
+  }
+
+  // Occurrences in a file no translation unit kept includes could have come
+  // from one that is gone or compiled differently now. Those that are still
+  // there are found again when the translation units are reindexed.
+  auto IsIncludedByKept = [DepDB, &Kept](StringRef File) {
+    for (const auto &SourceFile : DepDB->getSourceFiles(File))
+      if (Kept.count(getCanonicalPath(SourceFile)))
+        return true;
+    return false;
+  };
+
+  // Keep everything else.
+  for (uint32_t I = 0; I != Index.NumFiles; ++I) {
+    const auto *Record = Index.FileTable + uint64_t(I) * FileRecordSize;
+    const auto File = Index.getString(Record[0]);
+    if (ReindexAll || Changed.count(File) ||
+        (DepDB && !IsIncludedByKept(File)))
+      continue;
+
+    addFile(File, IndexStamps[I]);
+    const uint32_t End =
+        I + 1 == Index.NumFiles ? Index.NumOccurrences
+                                : uint32_t(Record[FileRecordSize + 1]);
+    for (uint32_t J = Record[1]; J != End; ++J) {
+      const auto *Occ =
+          Index.FileOccurrences + uint64_t(J) * OccurrenceRecordSize;
+      addOccurrence(Index.getString(Index.USRTable[uint64_t(Occ[2]) *
+                                                   USRRecordSize]),
+                    File, Occ[0], Occ[1]);
+    }
+  }
+  return Outdated;
+}
+
+// Returns the 1-based line and column of Offset in Buffer.
+static std::pair<unsigned, unsigned> getLineAndColumn(StringRef Buffer,
+                                                      unsigned Offset) {
+  const StringRef Before = Buffer.substr(0, Offset);
+  const size_t LineStart = Before.rfind('\n') + 1;
+  return std::make_pair(Before.count('\n') + 1, Offset - LineStart + 1);
+}
+
+bool renameFromIndex(const SymbolIndex &Index,
+                     const tooling::CompilationDatabase &Compilations,
+                     StringRef File, unsigned Offset, StringRef NewName,
+                     tooling::Replacements &Replaces, std::string &PrevName,
+                     bool PrintLocations) {
+  // The offset being renamed at is only meaningful in the file indexed.
+  const std::string Origin = getCanonicalPath(File);
+  if (!Index.isFileUpToDate(Origin)) {
+    errs() << "clang-rename: symbol index is out of date for " << Origin
+           << ".\n";
+    return false;
+  }
+  SymbolOccurrence At;
+  const auto USR = Index.getUSRAt(Origin, Offset, At);
+  if (USR.empty()) {
+    errs() << "clang-rename: symbol not in the index.\n";
+    return false;
+  }
+  std::string Stale;
+  if (!Index.isUpToDate(USR, Compilations, Stale)) {
+    errs() << "clang-rename: symbol index is out of date for " << Stale
+           << ".\n";
+    return false;
+  }
+
+  StringMap<std::unique_ptr<MemoryBuffer>> Buffers;
+  auto GetBuffer = [&Buffers](StringRef Path) -> const MemoryBuffer * {
+    auto &Buffer = Buffers[Path];
+    if (!Buffer) {
+      auto Contents = MemoryBuffer::getFile(Path);
+      if (!Contents)
+        return nullptr;
+      Buffer = std::move(*Contents);
+    }
+    return Buffer.get();
+  };
+
+  const auto *Buffer = GetBuffer(At.File);
+  if (!Buffer || At.Offset + At.Length > Buffer->getBufferSize())
+    return false;
+  const std::string Name =
+      Buffer->getBuffer().substr(At.Offset, At.Length).str();
+
+  // A file changed without changing its size and modification time still
+  // spells something else at an occurrence.
+  tooling::Replacements Found;
+  for (const auto &Occ : Index.getOccurrences(USR)) {
+    Buffer = GetBuffer(Occ.File);
+    if (!Buffer ||
+        Buffer->getBuffer().substr(Occ.Offset, Occ.Length) != Name) {
+      errs() << "clang-rename: symbol index is out of date for " << Occ.File
+             << ".\n";
+      return false;
+    }
+
+    if (PrintLocations) {
+      const auto LineAndColumn =
+          getLineAndColumn(Buffer->getBuffer(), Occ.Offset);
+      errs() << "clang-rename: renamed at: " << Occ.File << ":"
+             << LineAndColumn.first << ":" << LineAndColumn.second << "\n";
+    }
+    Found.insert(
+        tooling::Replacement(Occ.File, Occ.Offset, Occ.Length, NewName));
+  }
+  Replaces.insert(Found.begin(), Found.end());
+  PrevName = Name;
+  return true;
+}
+
+}
+}
@@ -0,0 +1,211 @@
+//===--- tools/extra/clang-rename/SymbolIndex.h - Clang rename tool -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief A persistent index of the locations every USR is spelled at, which
+/// lets a rename skip parsing altogether.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_SYMBOL_INDEX_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_SYMBOL_INDEX_H
+
+#include "ParallelRunner.h"
+#include "clang/Tooling/Refactoring.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace clang {
+class ASTConsumer;
+
+namespace rename {
+
+// A location a symbol's name is spelled at.
+struct SymbolOccurrence {
+  llvm::StringRef File;
+  unsigned Offset;
+  unsigned Length;
+};
+
+// What a file looked like when it was indexed. A file whose size and
+// modification time still match is not read again to compare the hash.
+struct FileStamp {
+  uint64_t Hash;
+  uint64_t Size;
+  uint64_t ModificationTime;
+};
+
+class SymbolIndex;
+
+// \brief Accumulates the occurrences of USRs before they are written out.
+class SymbolIndexBuilder {
+public:
+  void addOccurrence(llvm::StringRef USR, llvm::StringRef File,
+                     unsigned Offset, unsigned Length);
+
+  // Records the contents File was indexed with.
+  void addFile(llvm::StringRef File, const FileStamp &Stamp);
+
+  // Records that TU is indexed with its current compile command.
+  void addTranslationUnit(const TranslationUnit &TU);
+
+  // Adds all occurrences of Other, e.g. those another worker collected.
+  void merge(const SymbolIndexBuilder &Other);
+
+  // Adds what is still up to date in Index, given that the compilation
+  // database now holds TUs, and returns the translation units that must be
+  // reindexed: those Index has no entry for with the same compile command, and
+  // those depending on a file that changed or vanished since. The occurrences
+  // in such files are dropped, and found again when their dependents are
+  // reindexed. So are those in files that only reindexed translation units
+  // include, as a translation unit that is gone or compiled differently may
+  // have left them.
+  //
+  // Dependents of a changed header are looked up in the loaded
+  // DependencyDatabase. Without one, all translation units are reindexed if a
+  // header changed or a translation unit is gone or compiled differently.
+  std::vector<TranslationUnit>
+  addUpToDate(const SymbolIndex &Index, llvm::ArrayRef<TranslationUnit> TUs);
+
+  // Writes the index to Path. Returns false and sets ErrorMessage on failure.
+  bool write(llvm::StringRef Path, std::string &ErrorMessage) const;
+
+private:
+  struct Occurrence {
+    unsigned File, Offset, Length;
+
+    bool operator<(const Occurrence &Other) const {
+      if (File != Other.File)
+        return File < Other.File;
+      if (Offset != Other.Offset)
+        return Offset < Other.Offset;
+      return Length < Other.Length;
+    }
+  };
+
+  unsigned getFileID(llvm::StringRef File);
+
+  llvm::StringMap<unsigned> FileIDs;
+  std::vector<llvm::StringRef> Files;
+  // Parallel to Files; all zero if the file's contents were not recorded.
+  std::vector<FileStamp> Stamps;
+  llvm::StringMap<std::set<Occurrence>> USRs;
+  // The main files and command hashes of the indexed translation units.
+  std::set<std::pair<std::string, uint64_t>> TranslationUnits;
+};
+
+// \brief Collects the occurrences of every USR in the translation units it is
+// run on. Constructors are recorded under their class, as USRFindingAction
+// resolves them, and system headers are left out.
+class IndexingAction {
+public:
+  explicit IndexingAction(SymbolIndexBuilder &Builder) : Builder(Builder) {
+  }
+
+  std::unique_ptr<ASTConsumer> newASTConsumer();
+
+private:
+  SymbolIndexBuilder &Builder;
+};
+
+// \brief A memory mapped index written by SymbolIndexBuilder.
+class SymbolIndex {
+public:
+  static std::unique_ptr<SymbolIndex> load(llvm::StringRef Path,
+                                           std::string &ErrorMessage);
+
+  // Returns the USR spelled across Offset in File and sets Occurrence to that
+  // spelling, or returns an empty string if the index knows of none.
+  llvm::StringRef getUSRAt(llvm::StringRef File, unsigned Offset,
+                           SymbolOccurrence &Occurrence) const;
+
+  // Returns all occurrences of USR, ordered by file and offset.
+  std::vector<SymbolOccurrence> getOccurrences(llvm::StringRef USR) const;
+
+  // Returns whether File was indexed and still has the contents it was
+  // indexed with.
+  bool isFileUpToDate(llvm::StringRef File) const;
+
+  // Returns whether the index still describes the code that can refer to
+  // USR: the translation units of Compilations are those it indexed, with
+  // the same compile commands, and every file of those that include a file
+  // USR is spelled in still has the contents it was indexed with. Otherwise
+  // sets Stale to the first file found changed, new or gone.
+  //
+  // Files are traced to the translation units including them through the
+  // loaded DependencyDatabase; without one, every file is checked. Files
+  // that cannot refer to USR are left to the renames that can. The
+  // translation units are compared once per Compilations, which must not
+  // change while the index is in use.
+  bool isUpToDate(llvm::StringRef USR,
+                  const tooling::CompilationDatabase &Compilations,
+                  std::string &Stale) const;
+
+private:
+  friend class SymbolIndexBuilder;
+
+  typedef llvm::support::ulittle32_t Word;
+
+  explicit SymbolIndex(std::unique_ptr<llvm::MemoryBuffer> Buffer)
+      : Buffer(std::move(Buffer)), CheckedCompilations(nullptr) {
+  }
+
+  bool parse(std::string &ErrorMessage);
+
+  llvm::StringRef getString(uint32_t Offset) const {
+    return llvm::StringRef(Strings + Offset);
+  }
+
+  static uint64_t get64(const Word *Words) {
+    return uint64_t(Words[0]) | uint64_t(Words[1]) << 32;
+  }
+
+  static FileStamp getStamp(const Word *FileRecord) {
+    FileStamp Stamp = { get64(FileRecord + 2), get64(FileRecord + 4),
+                        get64(FileRecord + 6) };
+    return Stamp;
+  }
+
+  // Finds the entry of Key in a table of Count records of RecordSize words
+  // whose first word is a string offset, sorted by that string.
+  const Word *find(const Word *Table, uint32_t Count, unsigned RecordSize,
+                   llvm::StringRef Key) const;
+
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+  uint32_t NumFiles, NumUSRs, NumOccurrences, NumTUs;
+  const Word *FileTable, *USRTable, *Occurrences, *FileOccurrences, *TUTable;
+  const char *Strings;
+  // The database whose translation units were found to be those indexed.
+  mutable const tooling::CompilationDatabase *CheckedCompilations;
+};
+
+// Collects the replacements renaming the symbol spelled across Offset in File
+// to NewName from Index alone, and sets PrevName to its current spelling.
+// Compilations is the compilation database.
+//
+// Returns false, leaving Replaces alone, if the index does not know the
+// symbol or is out of date for it, see SymbolIndex::isUpToDate, as
+// occurrences may have moved, gone or been added since. The reason is
+// printed, so that the caller may parse instead.
+bool renameFromIndex(const SymbolIndex &Index,
+                     const tooling::CompilationDatabase &Compilations,
+                     llvm::StringRef File, unsigned Offset,
+                     llvm::StringRef NewName, tooling::Replacements &Replaces,
+                     std::string &PrevName, bool PrintLocations = false);
+
+}
+}
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_SYMBOL_INDEX_H
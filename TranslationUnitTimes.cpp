@@ -0,0 +1,145 @@
+//===--- tools/extra/clang-rename/TranslationUnitTimes.cpp - Clang rename ===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief How long each translation unit took to parse and traverse the last
+/// times it was renamed in, and how large its AST was, kept to schedule the
+/// next run.
+///
+//===----------------------------------------------------------------------===//
+
+#include "TranslationUnitTimes.h"
+#include "ParallelRunner.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdlib>
+
+using namespace llvm;
+
+namespace clang {
+namespace rename {
+
+TranslationUnitTimes::TranslationUnitTimes(StringRef Path) : Path(Path) {
+  auto Buffer = MemoryBuffer::getFile(Path);
+  if (!Buffer)
+    return;
+
+  SmallVector<StringRef, 0> Lines;
+  (*Buffer)->getBuffer().split(Lines, "\n", -1, /*KeepEmpty=*/false);
+  for (const auto Line : Lines) {
+    StringRef Hash, Seconds, Memory;
+    std::tie(Hash, Seconds) = Line.split(' ');
+    std::tie(Seconds, Memory) = Seconds.split(' ');
+    uint64_t Key;
+    if (Hash.getAsInteger(16, Key))
+      continue;
+    // StringRef has no getAsDouble yet.
+    const std::string Value = Seconds;
+    char *End;
+    Entry E;
+    E.Seconds = std::strtod(Value.c_str(), &End);
+    if (End == Value.c_str() || *End != '\0')
+      continue;
+    if (Memory.getAsInteger(10, E.Memory))
+      E.Memory = 0;
+    Entries[Key] = E;
+  }
+}
+
+std::string TranslationUnitTimes::getDefaultPath() {
+  SmallString<128> Path;
+  if (!sys::path::home_directory(Path))
+    return std::string();
+  sys::path::append(Path, ".cache", "clang-rename", "tu-times");
+  return Path.str();
+}
+
+bool TranslationUnitTimes::lookup(const tooling::CompileCommand &Command,
+                                  double &Seconds) const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  auto I = Entries.find(getCommandHash(Command));
+  if (I == Entries.end() || I->second.Seconds < 0)
+    return false;
+  Seconds = I->second.Seconds;
+  return true;
+}
+
+void TranslationUnitTimes::record(const tooling::CompileCommand &Command,
+                                  double Seconds) {
+  const uint64_t Key = getCommandHash(Command);
+  std::lock_guard<std::mutex> Lock(Mutex);
+  Entry Unknown = { -1, 0 };
+  auto &E = Entries.insert(std::make_pair(Key, Unknown)).first->second;
+  E.Seconds = E.Seconds < 0 ? Seconds : (E.Seconds + Seconds) / 2;
+}
+
+bool TranslationUnitTimes::lookupMemory(const tooling::CompileCommand &Command,
+                                        uint64_t &Bytes) const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  auto I = Entries.find(getCommandHash(Command));
+  if (I == Entries.end() || !I->second.Memory)
+    return false;
+  Bytes = I->second.Memory;
+  return true;
+}
+
+void TranslationUnitTimes::recordMemory(const tooling::CompileCommand &Command,
+                                        uint64_t Bytes) {
+  const uint64_t Key = getCommandHash(Command);
+  std::lock_guard<std::mutex> Lock(Mutex);
+  Entry Unknown = { -1, 0 };
+  Entries.insert(std::make_pair(Key, Unknown)).first->second.Memory = Bytes;
+}
+
+bool TranslationUnitTimes::save(std::string &ErrorMessage) const {
+  if (std::error_code EC =
+          sys::fs::create_directories(sys::path::parent_path(Path))) {
+    ErrorMessage = "cannot create the directory of " + Path + ": " +
+                   EC.message();
+    return false;
+  }
+
+  // Write through a temporary file, so that a concurrent run never reads
+  // half of the times.
+  int FD;
+  SmallString<128> TempPath;
+  if (std::error_code EC =
+          sys::fs::createUniqueFile(Path + "-%%%%%%", FD, TempPath)) {
+    ErrorMessage = "cannot write " + Path + ": " + EC.message();
+    return false;
+  }
+  {
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    std::lock_guard<std::mutex> Lock(Mutex);
+    for (const auto &E : Entries)
+      OS << format("%016llx %.6f %llu\n", (unsigned long long)E.first,
+                   E.second.Seconds, (unsigned long long)E.second.Memory);
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      sys::fs::remove(TempPath.str());
+      ErrorMessage = "cannot write " + Path;
+      return false;
+    }
+  }
+  if (std::error_code EC = sys::fs::rename(TempPath.str(), Path)) {
+    sys::fs::remove(TempPath.str());
+    ErrorMessage = "cannot write " + Path + ": " + EC.message();
+    return false;
+  }
+  return true;
+}
+
+}
+}
@@ -0,0 +1,81 @@
+//===--- tools/extra/clang-rename/TranslationUnitTimes.h - Clang rename tool =//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief How long each translation unit took to parse and traverse the last
+/// times it was renamed in, and how large its AST was, kept to schedule the
+/// next run.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_TRANSLATION_UNIT_TIMES_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_TRANSLATION_UNIT_TIMES_H
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringRef.h"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace clang {
+namespace rename {
+
+// Wall times and AST sizes of translation units, keyed by the hash of their
+// compile command, so that a command that changes starts over. They are read
+// from and written back to a small text file, one "<hash> <seconds> <bytes>"
+// line per command.
+//
+// record() and recordMemory() may be called from every worker thread.
+class TranslationUnitTimes {
+public:
+  // Reads the times in Path, if there is such a file.
+  explicit TranslationUnitTimes(llvm::StringRef Path);
+
+  // Returns the file times are kept in by default, or an empty string if
+  // there is no home directory to keep it in.
+  static std::string getDefaultPath();
+
+  // Sets Seconds to the time Command is expected to take. Returns false if
+  // it has not been run yet.
+  bool lookup(const tooling::CompileCommand &Command, double &Seconds) const;
+
+  // Records that Command took Seconds. Earlier runs are given as much weight
+  // as this one, to even out noise.
+  void record(const tooling::CompileCommand &Command, double Seconds);
+
+  // Sets Bytes to the memory the AST of Command held the last time it was
+  // parsed. Returns false if that is not known.
+  bool lookupMemory(const tooling::CompileCommand &Command,
+                    uint64_t &Bytes) const;
+
+  // Records that the AST of Command held Bytes.
+  void recordMemory(const tooling::CompileCommand &Command, uint64_t Bytes);
+
+  // Writes the times back to the file they were read from. Concurrent runs
+  // may each write; the last one wins.
+  bool save(std::string &ErrorMessage) const;
+
+private:
+  struct Entry {
+    // Negative if not known.
+    double Seconds;
+    // Zero if not known.
+    uint64_t Memory;
+  };
+
+  std::string Path;
+  mutable std::mutex Mutex;
+  std::unordered_map<uint64_t, Entry> Entries;
+};
+
+}
+}
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_TRANSLATION_UNIT_TIMES_H
@@ -13,18 +13,39 @@
 //===----------------------------------------------------------------------===//
 
 #include "USRFinder.h"
+#include "RenameStatistics.h"
+#include "StableHash.h"
 #include "clang/AST/AST.h"
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Lex/Lexer.h"
 #include "clang/Index/USRGeneration.h"
 #include "llvm/ADT/SmallVector.h"
+#include <algorithm>
+#include <tuple>
 
 using namespace llvm;
 
 namespace clang {
 namespace rename {
 
+// Sets File, Begin and End to the file and the offsets of the first and the
+// last token of Range, expanded out of macros. End is ~0U if Range ends in
+// another file. Returns false if Range is invalid.
+static bool getFileOffsets(const SourceManager &SourceMgr, SourceRange Range,
+                           FileID &File, unsigned &Begin, unsigned &End) {
+  if (Range.isInvalid())
+    return false;
+  std::tie(File, Begin) =
+      SourceMgr.getDecomposedLoc(SourceMgr.getExpansionLoc(Range.getBegin()));
+  FileID EndFile;
+  std::tie(EndFile, End) = SourceMgr.getDecomposedLoc(
+      SourceMgr.getExpansionRange(Range.getEnd()).second);
+  if (EndFile != File || End < Begin)
+    End = ~0U;
+  return true;
+}
+
 // NamedDeclFindingASTVisitor recursively visits each AST node to find the
 // symbol underneath the cursor.
 // FIXME: move to seperate .h/.cc file if this gets too large.
@@ -34,10 +55,27 @@ class NamedDeclFindingASTVisitor
 public:
   // \brief Finds the NamedDecl at a point in the source.
   // \param Point the location in the source to search for the NamedDecl.
-  explicit NamedDeclFindingASTVisitor(const SourceManager &SourceMgr,
-                                      const SourceLocation Point)
-      : Result(nullptr), SourceMgr(SourceMgr),
-        Point(Point) {
+  // \param PointFile the file of Point.
+  // \param PointOffset the offset in PointFile of the token Point is in.
+  NamedDeclFindingASTVisitor(const SourceManager &SourceMgr,
+                             const SourceLocation Point, FileID PointFile,
+                             unsigned PointOffset)
+      : Result(nullptr), SourceMgr(SourceMgr), Point(Point),
+        PointFile(PointFile), PointOffset(PointOffset) {
+  }
+
+  // Traversal: only descend into nodes around the point.
+
+  bool TraverseDecl(Decl *D) {
+    if (D && !mayContainPoint(D->getSourceRange()))
+      return true;
+    return RecursiveASTVisitor<NamedDeclFindingASTVisitor>::TraverseDecl(D);
+  }
+
+  bool TraverseStmt(Stmt *S) {
+    if (S && !mayContainPoint(S->getSourceRange()))
+      return true;
+    return RecursiveASTVisitor<NamedDeclFindingASTVisitor>::TraverseStmt(S);
   }
 
   // Declaration visitors:
@@ -159,6 +197,20 @@ private:
            setResult(Decl, Loc, Loc.getLocWithOffset(Offset - 1));
   }
 
+  // \brief Determines if a node spanning Range may hold the point. Nodes in
+  // other files, or whose range is unknown, may hold children written in the
+  // file of the point, e.g. through #include, and are not ruled out.
+  bool mayContainPoint(SourceRange Range) {
+    FileID File;
+    unsigned Begin, End;
+    if (!getFileOffsets(SourceMgr, Range, File, Begin, End) ||
+        File != PointFile)
+      return true;
+    // Both ends are where tokens start, so the last token of the node holds
+    // the point exactly if it starts where the token of the point does.
+    return Begin <= PointOffset && PointOffset <= End;
+  }
+
   // \brief Determines if the Point is within Start and End.
   bool isPointWithin(const SourceLocation Start, const SourceLocation End) {
     // FIXME: Add tests for Point == End.
@@ -170,30 +222,92 @@ private:
   const NamedDecl *Result;
   const SourceManager &SourceMgr;
   const SourceLocation Point; // The location to find the NamedDecl.
+  const FileID PointFile;
+  const unsigned PointOffset;
 };
 }
 
 const NamedDecl *getNamedDeclAt(const ASTContext &Context,
                                 const SourceLocation Point) {
+  if (!Point.isValid() || !Point.isFileID())
+    return nullptr;
+
+  // We only want to search the decls that exist in the same file as the point.
   const auto &SourceMgr = Context.getSourceManager();
-  const auto SearchFile = SourceMgr.getFilename(Point);
+  return TopLevelDeclIndex(Context, SourceMgr.getFileID(Point))
+      .getNamedDeclAt(Point);
+}
 
-  NamedDeclFindingASTVisitor Visitor(SourceMgr, Point);
+TopLevelDeclIndex::TopLevelDeclIndex(const ASTContext &Context, FileID File)
+    : Context(Context) {
+  const auto &SourceMgr = Context.getSourceManager();
+  unsigned Order = 0;
+  for (auto *D : Context.getTranslationUnitDecl()->decls()) {
+    Entry E;
+    E.Order = Order++;
+    E.D = D;
+    FileID DeclFile;
+    if (!getFileOffsets(SourceMgr, D->getSourceRange(), DeclFile, E.Begin,
+                        E.End) ||
+        (!File.isInvalid() && DeclFile != File))
+      continue;
+    Files[DeclFile].push_back(E);
+  }
 
-  // We only want to search the decls that exist in the same file as the point.
-  auto Decls = Context.getTranslationUnitDecl()->decls();
-  for (auto &CurrDecl : Decls) {
-    const auto FileLoc = CurrDecl->getLocStart();
-    const auto FileName = SourceMgr.getFilename(FileLoc);
-    // FIXME: Add test.
-    if (FileName == SearchFile) {
-      Visitor.TraverseDecl(CurrDecl);
-      if (const NamedDecl *Result = Visitor.getNamedDecl()) {
-        return Result;
-      }
+  for (auto &I : Files) {
+    auto &Entries = I.second;
+    std::stable_sort(Entries.begin(), Entries.end(),
+                     [](const Entry &A, const Entry &B) {
+      return A.Begin < B.Begin;
+    });
+    unsigned MaxEnd = 0;
+    for (auto &E : Entries) {
+      MaxEnd = std::max(MaxEnd, E.End);
+      E.MaxEnd = MaxEnd;
     }
   }
+}
+
+const NamedDecl *TopLevelDeclIndex::getNamedDeclAt(SourceLocation Point) const {
+  if (!Point.isValid() || !Point.isFileID())
+    return nullptr;
+
+  // Declarations are compared by the tokens they start and end with, so that
+  // one ending in the token of the point is found when the point is past its
+  // first character.
+  const auto &SourceMgr = Context.getSourceManager();
+  FileID File;
+  unsigned Offset;
+  std::tie(File, Offset) = SourceMgr.getDecomposedLoc(
+      Lexer::GetBeginningOfToken(Point, SourceMgr, Context.getLangOpts()));
+  auto I = Files.find(File);
+  if (I == Files.end())
+    return nullptr;
+
+  // The declarations holding the point start at or before it; walk back from
+  // the last of those until no earlier one reaches the point.
+  const auto &Entries = I->second;
+  auto It = std::upper_bound(Entries.begin(), Entries.end(), Offset,
+                             [](unsigned Value, const Entry &E) {
+    return Value < E.Begin;
+  });
+  SmallVector<const Entry *, 4> Candidates;
+  while (It != Entries.begin()) {
+    --It;
+    if (It->MaxEnd < Offset)
+      break;
+    if (It->End >= Offset)
+      Candidates.push_back(&*It);
+  }
+  std::sort(Candidates.begin(), Candidates.end(),
+            [](const Entry *A, const Entry *B) { return A->Order < B->Order; });
 
+  NamedDeclFindingASTVisitor Visitor(SourceMgr, Point, File, Offset);
+  for (const auto *E : Candidates) {
+    Visitor.TraverseDecl(E->D);
+    if (const NamedDecl *Result = Visitor.getNamedDecl())
+      return Result;
+  }
   return nullptr;
 }
 
@@ -207,5 +321,49 @@ std::string getUSRForDecl(const Decl *Decl) {
   return std::string(Buff.data(), Buff.size());
 }
 
+USRID getUSRID(StringRef USR) {
+  if (USR.empty())
+    return 0;
+
+  // The hash has to be stable across processes.
+  uint64_t Hash = hashBytes(USR);
+
+  // Stay clear of zero and of the keys DenseMap reserves for itself.
+  if (Hash == 0 || Hash >= ~0ULL - 1)
+    Hash = 1;
+  return Hash;
+}
+
+USRCache::~USRCache() {
+  auto &Stats = getStatistics();
+  Stats.USRCacheHits += Hits;
+  Stats.USRCacheMisses += Misses;
+}
+
+USRID USRCache::getUSRID(const Decl *Decl) {
+  if (Decl == nullptr)
+    return 0;
+
+  // Every redeclaration of an entity has the same USR.
+  Decl = Decl->getCanonicalDecl();
+  auto It = IDs.find(Decl);
+  if (It != IDs.end()) {
+    ++Hits;
+    return It->second;
+  }
+
+  ++Misses;
+  const auto USR = getUSRForDecl(Decl);
+  const auto ID = rename::getUSRID(USR);
+  if (ID) {
+    auto &Entry = Strings.GetOrCreateValue(USR);
+    auto Inserted = USRs.insert(std::make_pair(ID, Entry.getKey()));
+    if (!Inserted.second && Inserted.first->second != Entry.getKey())
+      Collisions.insert(ID);
+  }
+  IDs[Decl] = ID;
+  return ID;
+}
+
 } // namespace clang
 } // namespace rename
@@ -15,12 +15,18 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_USR_FINDER_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_USR_FINDER_H
 
+#include "clang/Basic/SourceLocation.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace clang {
 class ASTContext;
 class Decl;
-class SourceLocation;
 class NamedDecl;
 
 namespace rename {
@@ -30,9 +36,90 @@ namespace rename {
 const NamedDecl *getNamedDeclAt(const ASTContext &Context,
                                 const SourceLocation Point);
 
+// The top-level declarations of an AST by the file they are written in,
+// sorted by offset, so that only those around a point are traversed to find
+// the symbol there. Build one to look up many points in the same AST;
+// getNamedDeclAt builds one for the file of its point only.
+class TopLevelDeclIndex {
+public:
+  // Indexes the declarations written in File, or in every file if File is
+  // invalid.
+  explicit TopLevelDeclIndex(const ASTContext &Context,
+                             FileID File = FileID());
+
+  // Returns getNamedDeclAt(Context, Point).
+  const NamedDecl *getNamedDeclAt(SourceLocation Point) const;
+
+private:
+  struct Entry {
+    // The offsets of the first and the last token of the declaration,
+    // expanded out of macros. End is ~0U if it ends in another file.
+    unsigned Begin;
+    unsigned End;
+    // The largest End of this and every earlier entry.
+    unsigned MaxEnd;
+    // The position of the declaration in the translation unit, as
+    // overlapping declarations, e.g. "struct S {} s;", are searched in order.
+    unsigned Order;
+    Decl *D;
+  };
+
+  const ASTContext &Context;
+  llvm::DenseMap<FileID, std::vector<Entry>> Files;
+};
+
 // Converts a Decl into a USR.
 std::string getUSRForDecl(const Decl *Decl);
 
+// Identifies a USR by a 64-bit hash of its spelling, which is the same in
+// every translation unit and process. Zero stands for "no USR".
+typedef uint64_t USRID;
+
+// Converts a USR into its ID.
+USRID getUSRID(llvm::StringRef USR);
+
+// \brief Memoizes the USRs of the declarations of a single ASTContext.
+//
+// A USR is generated once per canonical declaration and interned, so that
+// visitors compare USRs as integers. Hits and misses are added to the
+// process statistics when the cache is destroyed.
+class USRCache {
+public:
+  USRCache() : Hits(0), Misses(0) {
+  }
+  ~USRCache();
+
+  // Returns the ID of the USR of Decl, or zero if it has none.
+  USRID getUSRID(const Decl *Decl);
+
+  // Returns the USR of Decl, or an empty string if it has none.
+  llvm::StringRef getUSR(const Decl *Decl) {
+    return getUSR(getUSRID(Decl));
+  }
+
+  // Returns the USR an ID returned by getUSRID stands for. If the ID is
+  // ambiguous, this is the first of its USRs that was seen.
+  llvm::StringRef getUSR(USRID ID) const {
+    return ID ? USRs.lookup(ID) : llvm::StringRef();
+  }
+
+  // Returns whether different USRs of the ASTContext hash to ID, in which
+  // case the USRs with that ID have to be compared as strings.
+  bool isAmbiguous(USRID ID) const {
+    return Collisions.count(ID);
+  }
+
+private:
+  USRCache(const USRCache &) = delete;
+  void operator=(const USRCache &) = delete;
+
+  llvm::DenseMap<const Decl *, USRID> IDs;
+  llvm::DenseMap<USRID, llvm::StringRef> USRs;
+  llvm::DenseSet<USRID> Collisions;
+  llvm::StringMap<char> Strings;
+  unsigned Hits, Misses;
+};
+
 }
 }
 
@@ -38,7 +38,7 @@ namespace rename {
 
 // Get the USRs for the constructors of the class.
 static std::vector<std::string> getAllConstructorUSRs(
-    const CXXRecordDecl *Decl) {
+    const CXXRecordDecl *Decl, USRCache &Cache) {
   std::vector<std::string> USRs;
 
   // We need to get the definition of the record (as opposed to any forward
@@ -47,7 +47,7 @@ static std::vector<std::string> getAllConstructorUSRs(
 
   // Iterate over all the constructors and add their USRs.
   for (const auto &CtorDecl : RecordDecl->ctors())
-    USRs.push_back(getUSRForDecl(CtorDecl));
+    USRs.push_back(Cache.getUSR(CtorDecl));
 
   // Ignore destructors. GetLocationsOfUSR will find the declaration of and
   // explicit calls to a destructor through TagTypeLoc (and it is better for the
@@ -63,42 +63,121 @@ static std::vector<std::string> getAllConstructorUSRs(
   return USRs;
 }
 
-struct NamedDeclFindingConsumer : public ASTConsumer {
-  void HandleTranslationUnit(ASTContext &Context) override {
-    const auto &SourceMgr = Context.getSourceManager();
-    auto &FileMgr = SourceMgr.getFileManager();
-
-    clang::FileID FileID = SourceMgr.translateFile(FileMgr.getFile(FilePath));
-    // The file we look for the USR in will always be the main source file.
-    const auto Point =
-        SourceMgr.getLocForStartOfFile(FileID).getLocWithOffset(SymbolOffset);
-    if (!Point.isValid())
-      return;
-    const NamedDecl *FoundDecl = getNamedDeclAt(Context, Point);
-    if (FoundDecl == nullptr) {
-      FullSourceLoc FullLoc(Point, SourceMgr);
-      errs() << "clang-rename: could not find symbol at "
-             << SourceMgr.getFilename(Point) << ":"
-             << FullLoc.getSpellingLineNumber() << ":"
-             << FullLoc.getSpellingColumnNumber() << " (offset " << SymbolOffset
-             << ").\n";
-      return;
+// Returns whether every member function and static data member of Record,
+// and of the classes nested in it, is defined in the translation unit, so
+// that all code that may use a private member of Record is there. Pure
+// virtual functions count too, as they may have a definition, which must be
+// there for destructors. Templates and classes with member templates never
+// are, as their members may be specialized in other translation units.
+static bool isDefinedHere(const CXXRecordDecl &Record) {
+  const auto *Definition = Record.getDefinition();
+  if (!Definition || Definition->hasFriends() ||
+      Definition->isDependentContext() ||
+      isa<ClassTemplateSpecializationDecl>(Definition))
+    return false;
+
+  for (const auto *Member : Definition->decls()) {
+    if (isa<FunctionTemplateDecl>(Member) || isa<ClassTemplateDecl>(Member) ||
+        isa<VarTemplateDecl>(Member))
+      return false;
+
+    if (const auto *Nested = dyn_cast<CXXRecordDecl>(Member)) {
+      if (!Nested->isInjectedClassName() && !isDefinedHere(*Nested))
+        return false;
+      continue;
+    }
+
+    // The initializer of a static data member defined out of line may use
+    // private members, unless it was given in the class.
+    if (const auto *Var = dyn_cast<VarDecl>(Member)) {
+      if (Var->isStaticDataMember() && !Var->getDefinition() &&
+          !Var->getAnyInitializer())
+        return false;
+      continue;
     }
 
-    // If the decl is a constructor or destructor, we want to instead take the
-    // decl of the parent record.
-    if (const auto *CtorDecl = dyn_cast<CXXConstructorDecl>(FoundDecl))
-      FoundDecl = CtorDecl->getParent();
-    else if (const auto *DtorDecl = dyn_cast<CXXDestructorDecl>(FoundDecl))
-      FoundDecl = DtorDecl->getParent();
+    const auto *Function = dyn_cast<FunctionDecl>(Member);
+    if (!Function || Function->isImplicit() || Function->isDeleted() ||
+        Function->isDefaulted())
+      continue;
+    const FunctionDecl *FunctionDefinition;
+    if (!Function->isDefined(FunctionDefinition))
+      return false;
+  }
+  return true;
+}
 
-    // If the decl is in any way relatedpp to a class, we want to make sure we
-    // search for the constructor and destructor as well as everything else.
-    if (const auto *Record = dyn_cast<CXXRecordDecl>(FoundDecl))
-      *USRs = getAllConstructorUSRs(Record);
+SymbolScope getSymbolScope(const NamedDecl &Decl) {
+  // A local extern declaration, e.g. "void f() { extern int g; }", names an
+  // entity declared outside of the function.
+  if (Decl.getParentFunctionOrMethod() && !Decl.isLocalExternDecl() &&
+      !Decl.hasExternalFormalLinkage())
+    return SymbolScope::Function;
+
+  if (Decl.getAccess() == AS_private) {
+    const auto *Record = dyn_cast<CXXRecordDecl>(Decl.getDeclContext());
+    // A static data member may be defined in another translation unit.
+    const auto *Var = dyn_cast<VarDecl>(&Decl);
+    if (Record && isDefinedHere(*Record) &&
+        (!Var || !Var->isStaticDataMember() || Var->getDefinition()))
+      return SymbolScope::TranslationUnit;
+  }
 
-    USRs->push_back(getUSRForDecl(FoundDecl));
-    *SpellingName = FoundDecl->getNameAsString();
+  if (!Decl.isExternallyVisible())
+    return SymbolScope::File;
+  return SymbolScope::Global;
+}
+
+const NamedDecl *findUSRsAt(ASTContext &Context, StringRef FilePath,
+                            unsigned Offset, USRCache &Cache,
+                            std::vector<std::string> &USRs,
+                            std::string &SpellingName) {
+  const auto &SourceMgr = Context.getSourceManager();
+  auto &FileMgr = SourceMgr.getFileManager();
+
+  const auto *File = FileMgr.getFile(FilePath);
+  if (!File)
+    return nullptr;
+  clang::FileID FileID = SourceMgr.translateFile(File);
+  // The file we look for the USR in will always be the main source file.
+  const auto Point =
+      SourceMgr.getLocForStartOfFile(FileID).getLocWithOffset(Offset);
+  if (!Point.isValid())
+    return nullptr;
+  const NamedDecl *FoundDecl = getNamedDeclAt(Context, Point);
+  if (FoundDecl == nullptr) {
+    FullSourceLoc FullLoc(Point, SourceMgr);
+    errs() << "clang-rename: could not find symbol at "
+           << SourceMgr.getFilename(Point) << ":"
+           << FullLoc.getSpellingLineNumber() << ":"
+           << FullLoc.getSpellingColumnNumber() << " (offset " << Offset
+           << ").\n";
+    return nullptr;
+  }
+
+  // If the decl is a constructor or destructor, we want to instead take the
+  // decl of the parent record.
+  if (const auto *CtorDecl = dyn_cast<CXXConstructorDecl>(FoundDecl))
+    FoundDecl = CtorDecl->getParent();
+  else if (const auto *DtorDecl = dyn_cast<CXXDestructorDecl>(FoundDecl))
+    FoundDecl = DtorDecl->getParent();
+
+  // If the decl is in any way relatedpp to a class, we want to make sure we
+  // search for the constructor and destructor as well as everything else.
+  if (const auto *Record = dyn_cast<CXXRecordDecl>(FoundDecl))
+    USRs = getAllConstructorUSRs(Record, Cache);
+  else
+    USRs.clear();
+
+  USRs.push_back(Cache.getUSR(FoundDecl));
+  SpellingName = FoundDecl->getNameAsString();
+  return FoundDecl;
+}
+
+struct NamedDeclFindingConsumer : public ASTConsumer {
+  void HandleTranslationUnit(ASTContext &Context) override {
+    USRCache Cache;
+    findUSRsAt(Context, FilePath, SymbolOffset, Cache, *USRs, *SpellingName);
   }
 
   unsigned SymbolOffset;
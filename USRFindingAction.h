@@ -17,14 +17,48 @@
 
 #include <clang/Frontend/FrontendAction.h>
 #include <llvm/ADT/StringRef.h>
+#include <string>
+#include <vector>
 
 namespace clang {
 class ASTConsumer;
+class ASTContext;
 class CompilerInstance;
 class NamedDecl;
 
 namespace rename {
 
+class USRCache;
+
+// Where references to a symbol can be.
+enum class SymbolScope {
+  // Only in the function it is declared in: a local or a parameter.
+  Function,
+  // Only in the code of the translation unit it was found in: a private
+  // member of a class that is not a template, whose members and nested
+  // classes are all defined there, and that has no friends.
+  TranslationUnit,
+  // Only in translation units that see one of its declarations: an entity
+  // without external linkage, e.g. a static function or one in an anonymous
+  // namespace.
+  File,
+  // Anywhere.
+  Global
+};
+
+// Classifies Decl, a declaration in the translation unit of its ASTContext.
+SymbolScope getSymbolScope(const NamedDecl &Decl);
+
+// Finds the symbol at Offset in FilePath in the translation unit of Context,
+// and sets USRs to the USRs to rename along with it and SpellingName to its
+// name. Returns the declaration of the symbol, or null if FilePath is not
+// part of the translation unit, or if there is no symbol at Offset, in which
+// case an error is printed.
+const NamedDecl *findUSRsAt(ASTContext &Context, llvm::StringRef FilePath,
+                            unsigned Offset, USRCache &Cache,
+                            std::vector<std::string> &USRs,
+                            std::string &SpellingName);
+
 struct USRFindingAction {
   USRFindingAction(llvm::StringRef Path, unsigned Offset)
     : SymbolOffset(Offset), FilePath(Path)
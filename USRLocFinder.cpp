@@ -9,18 +9,25 @@
 ///
 /// \file
 /// \brief Mehtods for finding all instances of a USR. Our strategy is very
-/// simple; we just compare the USR at every relevant AST node with the one
-/// provided.
+/// simple; we just look up the USR at every relevant AST node in the set of
+/// USRs provided. Generating a USR is expensive, so nodes are first checked
+/// for the name of the symbol by comparing IdentifierInfo pointers.
 ///
 //===----------------------------------------------------------------------===//
 
 #include "USRLocFinder.h"
+#include "FileFilter.h"
+#include "LexicalFilter.h"
+#include "RenameStatistics.h"
 #include "USRFinder.h"
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/Basic/IdentifierTable.h"
 #include "clang/Basic/SourceLocation.h"
 #include "clang/Index/USRGeneration.h"
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringSet.h"
 
 using namespace llvm;
 
@@ -28,20 +35,52 @@ namespace clang {
 namespace rename {
 
 namespace {
-// \brief This visitor recursively searches for all instances of a USR in a
-// translation unit and stores them for later usage.
+// \brief This visitor recursively searches for all declarations of and
+// references to named entities in a translation unit and hands them to an
+// OccurrenceHandler.
 class USRLocFindingASTVisitor
     : public clang::RecursiveASTVisitor<USRLocFindingASTVisitor> {
 public:
-  explicit USRLocFindingASTVisitor(const std::string USR) : USR(USR) {
+  USRLocFindingASTVisitor(OccurrenceHandler &Handler, const FileFilter *Filter)
+      : Handler(Handler), Filter(Filter), NodesVisited(0), DeclsSkipped(0) {
+  }
+
+  ~USRLocFindingASTVisitor() {
+    getStatistics().NodesVisited += NodesVisited;
+    getStatistics().DeclsSkipped += DeclsSkipped;
+  }
+
+  // Skips declarations at namespace scope in files the filter rules out,
+  // e.g. system headers. Out-of-line member definitions count, as they are
+  // written there.
+  bool TraverseDecl(Decl *D) {
+    if (Filter && D) {
+      const DeclContext *Context = D->getLexicalDeclContext();
+      if (Context && Context->getRedeclContext()->isFileContext() &&
+          !Filter->mayContainOccurrences(*D)) {
+        ++DeclsSkipped;
+        return true;
+      }
+    }
+    return RecursiveASTVisitor<USRLocFindingASTVisitor>::TraverseDecl(D);
+  }
+
+  // Counted for -stats; every node passes one of these.
+
+  bool VisitDecl(const Decl *) {
+    ++NodesVisited;
+    return true;
+  }
+
+  bool VisitStmt(const Stmt *) {
+    ++NodesVisited;
+    return true;
   }
 
   // Declaration visitors:
 
   bool VisitNamedDecl(const NamedDecl *Decl) {
-    if (getUSRForDecl(Decl) == USR) {
-      LocationsFound.push_back(Decl->getLocation());
-    }
+    report(Decl, Decl->getLocation());
     return true;
   }
 
@@ -51,30 +90,25 @@ public:
     const auto *Decl = Expr->getFoundDecl();
 
     checkNestedNameSpecifierLoc(Expr->getQualifierLoc());
-    if (getUSRForDecl(Decl) == USR) {
-      LocationsFound.push_back(Expr->getLocation());
-    }
+    report(Decl, Expr->getLocation());
 
     return true;
   }
 
   bool VisitMemberExpr(const MemberExpr *Expr) {
     const auto *Decl = Expr->getFoundDecl().getDecl();
-    if (getUSRForDecl(Decl) == USR) {
-      LocationsFound.push_back(Expr->getMemberLoc());
-    }
+    report(Decl, Expr->getMemberLoc());
     return true;
   }
 
   bool VisitTypeLoc(TypeLoc TL) {
+    ++NodesVisited;
     switch(TL.getTypeLocClass()) {
       // TODO case TypeLoc::ObjCObject:
 
       case TypeLoc::InjectedClassName: {
         if (auto TSTL = TL.getAs<InjectedClassNameTypeLoc>()) {
-          if (getUSRForDecl(TSTL.getDecl()) == USR) {
-            LocationsFound.push_back(TL.getBeginLoc());
-          }
+          report(TSTL.getDecl(), TL.getBeginLoc());
         }
         break;
       }
@@ -83,9 +117,7 @@ public:
         if (auto TSTL = TL.getAs<TemplateSpecializationTypeLoc>()) {
           if (auto TT = dyn_cast<TemplateSpecializationType>(TL.getTypePtr())) {
             if (auto TD = TT->getTemplateName().getAsTemplateDecl()) {
-              if (getUSRForDecl(TD->getTemplatedDecl()) == USR) {
-                LocationsFound.push_back(TL.getBeginLoc());
-              }
+              report(TD->getTemplatedDecl(), TL.getBeginLoc());
             }
           }
         }
@@ -95,9 +127,7 @@ public:
       // typedef is tricky
       case TypeLoc::Typedef: {
         if (auto TDT = dyn_cast<TypedefType>(TL.getTypePtr())) {
-          if (getUSRForDecl(TDT->getDecl()) == USR) {
-            LocationsFound.push_back(TL.getBeginLoc());
-          }
+          report(TDT->getDecl(), TL.getBeginLoc());
         }
         break;
       }
@@ -114,9 +144,7 @@ public:
         // read Clang`s definition (in RecordDecl) -- not exactly what you think
         // so we use the length of name
         if (auto TT = dyn_cast<TagType>(TL.getTypePtr())) {
-          if (getUSRForDecl(TT->getDecl()) == USR) {
-            LocationsFound.push_back(TL.getBeginLoc());
-          }
+          report(TT->getDecl(), TL.getBeginLoc());
         }
         break;
       }
@@ -126,7 +154,47 @@ public:
     return true;
   }
 
-  // Non-visitors:
+private:
+  // Namespace traversal:
+  void checkNestedNameSpecifierLoc(NestedNameSpecifierLoc NameLoc) {
+    while (NameLoc) {
+      const auto *Decl = NameLoc.getNestedNameSpecifier()->getAsNamespace();
+      if (Decl)
+        report(Decl, NameLoc.getLocalBeginLoc());
+      NameLoc = NameLoc.getPrefix();
+    }
+  }
+
+  void report(const NamedDecl *Decl, SourceLocation Loc) {
+    Handler.handleOccurrence(Decl, Loc);
+  }
+
+  OccurrenceHandler &Handler;
+  const FileFilter *Filter;
+  uint64_t NodesVisited;
+  uint64_t DeclsSkipped;
+};
+
+// \brief Collects the locations of a set of USRs.
+class USRSetMatcher : public OccurrenceHandler {
+public:
+  // \param Name the identifier all searched declarations are spelled as, or
+  // null if the name is not an identifier (e.g. an operator).
+  USRSetMatcher(const std::vector<std::string> &USRs,
+                const IdentifierInfo *Name, USRCache &Cache)
+      : Name(Name), Cache(Cache) {
+    for (const auto &USR : USRs) {
+      if (auto ID = getUSRID(USR)) {
+        this->USRs.insert(ID);
+        Strings.insert(USR);
+      }
+    }
+  }
+
+  void handleOccurrence(const NamedDecl *Decl, SourceLocation Loc) override {
+    if (hasSearchedName(Decl) && hasSearchedUSR(Decl))
+      LocationsFound.push_back(Loc);
+  }
 
   // \brief Returns a list of unique locations. Duplicate or overlapping
   // locations are erroneous and should be reported!
@@ -135,28 +203,70 @@ public:
   }
 
 private:
-  // Namespace traversal:
-  void checkNestedNameSpecifierLoc(NestedNameSpecifierLoc NameLoc) {
-    while (NameLoc) {
-      const auto *Decl = NameLoc.getNestedNameSpecifier()->getAsNamespace();
-      if (Decl && getUSRForDecl(Decl) == USR)
-        LocationsFound.push_back(NameLoc.getLocalBeginLoc());
-      NameLoc = NameLoc.getPrefix();
+  // \brief Cheaply determines whether Decl is spelled as the searched name.
+  bool hasSearchedName(const NamedDecl *Decl) const {
+    if (!Name)
+      return true;
+
+    const auto DeclName = Decl->getDeclName();
+    switch (DeclName.getNameKind()) {
+      case DeclarationName::Identifier:
+        return DeclName.getAsIdentifierInfo() == Name;
+
+      // Constructors and destructors are spelled as their class.
+      case DeclarationName::CXXConstructorName:
+      case DeclarationName::CXXDestructorName: {
+        const auto *Record = DeclName.getCXXNameType()->getAsCXXRecordDecl();
+        return !Record || Record->getIdentifier() == Name;
+      }
+
+      // Be conservative about everything else, e.g. Objective-C selectors.
+      default:
+        return true;
     }
   }
 
-  // All the locations of the USR were found.
-  const std::string USR;
+  // \brief Determines whether Decl has one of the searched USRs. The IDs
+  // are compared first; as different USRs may hash to the same ID, the
+  // strings are compared as well when they match.
+  bool hasSearchedUSR(const NamedDecl *Decl) const {
+    const USRID ID = Cache.getUSRID(Decl);
+    if (!USRs.count(ID))
+      return false;
+    if (Cache.isAmbiguous(ID))
+      return Strings.count(getUSRForDecl(Decl));
+    return Strings.count(Cache.getUSR(ID));
+  }
+
+  // The USRs to search for, as IDs and as strings.
+  llvm::DenseSet<USRID> USRs;
+  llvm::StringSet<> Strings;
+  const IdentifierInfo *Name;
+  USRCache &Cache;
+  // All the locations of the USRs were found.
   std::vector<clang::SourceLocation> LocationsFound;
 };
 } // namespace
 
-std::vector<SourceLocation> getLocationsOfUSR(const std::string USR,
-                                              Decl *Decl) {
-  USRLocFindingASTVisitor visitor(USR);
+std::vector<SourceLocation>
+getLocationsOfUSRs(const std::vector<std::string> &USRs, StringRef Name,
+                   Decl *Decl, USRCache &Cache, const FileFilter *Filter) {
+  // Resolve the name once per translation unit so that nodes are compared by
+  // pointer. If the identifier has not been seen in the translation unit, the
+  // lookup adds an entry no declaration refers to, and nothing matches.
+  const IdentifierInfo *II = nullptr;
+  if (isIdentifier(Name))
+    II = &Decl->getASTContext().Idents.get(Name);
+
+  USRSetMatcher Matcher(USRs, II, Cache);
+  forEachOccurrence(Decl, Matcher, Filter);
+  return Matcher.getLocationsFound();
+}
 
+void forEachOccurrence(Decl *Decl, OccurrenceHandler &Handler,
+                       const FileFilter *Filter) {
+  USRLocFindingASTVisitor visitor(Handler, Filter);
   visitor.TraverseDecl(Decl);
-  return visitor.getLocationsFound();
 }
 
 } // namespace rename
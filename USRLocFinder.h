@@ -16,19 +16,46 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_USR_LOC_FINDER_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_USR_LOC_FINDER_H
 
+#include "llvm/ADT/StringRef.h"
 #include <string>
 #include <vector>
 
 namespace clang {
 
 class Decl;
+class NamedDecl;
 class SourceLocation;
 
 namespace rename {
 
+class FileFilter;
+class USRCache;
+
+// Receives the declarations of and references to named entities found by
+// forEachOccurrence.
+class OccurrenceHandler {
+public:
+  virtual ~OccurrenceHandler() {}
+
+  // Called with the entity Decl and the location its name is spelled at.
+  virtual void handleOccurrence(const NamedDecl *Decl, SourceLocation Loc) = 0;
+};
+
+// Reports every declaration of and reference to a named entity under decl,
+// the way getLocationsOfUSRs looks at them. With Filter, declarations at
+// namespace scope it rules out are skipped.
+void forEachOccurrence(Decl *decl, OccurrenceHandler &Handler,
+                       const FileFilter *Filter = nullptr);
+
+// Finds the locations of every USR in USRs in a single traversal of decl.
+// Name is the spelling shared by all of the USRs' declarations; USRs are only
+// generated for declarations spelled that way, through the cache of decl's
+// ASTContext. With Filter, files it rules out are not searched.
 // FIXME: make this an AST matcher. Wouldn't that be awesome??? I agree!
-std::vector<SourceLocation> getLocationsOfUSR(const std::string usr,
-                                              Decl *decl);
+std::vector<SourceLocation>
+getLocationsOfUSRs(const std::vector<std::string> &USRs, llvm::StringRef Name,
+                   Decl *decl, USRCache &Cache,
+                   const FileFilter *Filter = nullptr);
 }
 }
 
@@ -0,0 +1,431 @@
+//===--- tools/extra/clang-rename/Benchmark.cpp - Clang rename bench ------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief clang-rename-bench generates a synthetic project and times the
+/// steps of a rename in it, writing the results as JSON so that runs may be
+/// compared by scripts.
+///
+//===----------------------------------------------------------------------===//
+
+#include "ProjectGenerator.h"
+#include "YAMLBaseline.h"
+#include "../FileFilter.h"
+#include "../ParallelRunner.h"
+#include "../RenameDriver.h"
+#include "../USRFinder.h"
+#include "../USRLocFinder.h"
+#include "../src/DependencyDatabase.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace llvm;
+using namespace clang;
+
+static cl::OptionCategory BenchCategory("clang-rename-bench options");
+
+static cl::opt<std::string> Directory(
+    cl::Positional, cl::Required, cl::desc("<directory>"),
+    cl::cat(BenchCategory));
+static cl::opt<unsigned> TUs(
+    "tus", cl::desc("Source files to generate"), cl::init(100),
+    cl::cat(BenchCategory));
+static cl::opt<unsigned> Headers(
+    "headers", cl::desc("Headers to generate"), cl::init(20),
+    cl::cat(BenchCategory));
+static cl::opt<unsigned> FanIn(
+    "fan-in", cl::desc("Headers included by each source file"), cl::init(5),
+    cl::cat(BenchCategory));
+static cl::opt<unsigned> Classes(
+    "classes", cl::desc("Classes declared in each header"), cl::init(10),
+    cl::cat(BenchCategory));
+static cl::opt<unsigned> TemplateDepth(
+    "template-depth", cl::desc("Depth of the template instantiated by each "
+                               "class"),
+    cl::init(3), cl::cat(BenchCategory));
+static cl::opt<unsigned> Constructors(
+    "constructors", cl::desc("Constructors of the class whose occurrences "
+                             "are found with more and more USRs"),
+    cl::init(256), cl::cat(BenchCategory));
+static cl::opt<unsigned> Iterations(
+    "iterations", cl::desc("Times to run each benchmark"), cl::init(5),
+    cl::cat(BenchCategory));
+static cl::opt<unsigned> Jobs(
+    "j", cl::desc("Translation units to rename in in parallel, 0 for one per "
+                  "hardware thread"),
+    cl::init(0), cl::cat(BenchCategory));
+static cl::opt<std::string> OutputPath(
+    "o", cl::desc("Write the results to <file> instead of standard output"),
+    cl::value_desc("file"), cl::cat(BenchCategory));
+
+const char BenchUsage[] = "Benchmarks clang-rename on a synthetic project.\n\
+clang-rename-bench writes a project of the given shape, and its\n\
+compile_filedeps.json, into <directory>, then times parsing and loading\n\
+the dependency database, looking up and finding the occurrences of a\n\
+symbol in one translation unit, finding those of a class with more and\n\
+more of its constructor USRs, and renaming the symbol in all of them.\n\
+Parsing the database is compared with the llvm::yaml reader it replaced,\n\
+by time and by peak memory. The results are written as JSON, the times in\n\
+milliseconds.\n";
+
+namespace {
+
+// The times a benchmark took, one per iteration.
+struct Result {
+  std::string Name;
+  // The operations timed by each iteration, e.g. the lookups.
+  size_t Operations;
+  std::vector<double> Seconds;
+  // How much the peak resident set grew in one more run, in kilobytes, or -1
+  // if it was not measured.
+  long PeakRSSGrowth;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+} // end namespace
+
+// Runs Body Iterations times, with Prepare untimed before each, and records
+// the times in Results. Returns false if Body failed.
+static bool measure(std::vector<Result> &Results, StringRef Name,
+                    size_t Operations, const std::function<bool()> &Body,
+                    const std::function<void()> &Prepare =
+                        std::function<void()>()) {
+  errs() << "clang-rename-bench: " << Name << "\n";
+  Result R;
+  R.Name = Name;
+  R.Operations = Operations;
+  R.PeakRSSGrowth = -1;
+  for (unsigned I = 0; I != Iterations; ++I) {
+    if (Prepare)
+      Prepare();
+    const auto Start = Clock::now();
+    if (!Body())
+      return false;
+    R.Seconds.push_back(
+        std::chrono::duration<double>(Clock::now() - Start).count());
+  }
+  Results.push_back(std::move(R));
+  return true;
+}
+
+// Returns the peak resident set of this process, in kilobytes.
+static long getPeakRSS() {
+  rusage Usage;
+  if (getrusage(RUSAGE_SELF, &Usage))
+    return -1;
+  return Usage.ru_maxrss;
+}
+
+// Runs Body once more, after Prepare, in a forked process, and records in
+// the last of Results how much that process's peak resident set grew. A
+// forked process starts with the resident set of this one as its peak, so
+// what earlier benchmarks allocated does not count.
+static void measurePeakRSS(std::vector<Result> &Results,
+                           const std::function<bool()> &Body,
+                           const std::function<void()> &Prepare =
+                               std::function<void()>()) {
+  int Pipe[2];
+  if (::pipe(Pipe))
+    return;
+  const pid_t Child = ::fork();
+  if (Child == 0) {
+    ::close(Pipe[0]);
+    if (Prepare)
+      Prepare();
+    const long Start = getPeakRSS();
+    long Growth = Body() && Start >= 0 ? getPeakRSS() - Start : -1;
+    ssize_t Written = ::write(Pipe[1], &Growth, sizeof(Growth));
+    ::_exit(Written == sizeof(Growth) ? 0 : 1);
+  }
+  ::close(Pipe[1]);
+  long Growth = -1;
+  if (Child > 0) {
+    if (::read(Pipe[0], &Growth, sizeof(Growth)) != sizeof(Growth))
+      Growth = -1;
+    int Status;
+    ::waitpid(Child, &Status, 0);
+  }
+  ::close(Pipe[0]);
+  Results.back().PeakRSSGrowth = Growth;
+}
+
+static void writeResults(raw_ostream &OS, ArrayRef<Result> Results,
+                         unsigned NumJobs) {
+  OS << "{\n"
+     << "  \"project\": {\"tus\": " << TUs << ", \"headers\": " << Headers
+     << ", \"fan_in\": " << FanIn << ", \"classes\": " << Classes
+     << ", \"template_depth\": " << TemplateDepth
+     << ", \"constructors\": " << Constructors << "},\n"
+     << "  \"iterations\": " << Iterations << ",\n"
+     << "  \"jobs\": " << NumJobs << ",\n"
+     << "  \"benchmarks\": [";
+  for (size_t I = 0, E = Results.size(); I != E; ++I) {
+    const Result &R = Results[I];
+    std::vector<double> Sorted(R.Seconds);
+    std::sort(Sorted.begin(), Sorted.end());
+    double Sum = 0;
+    for (double S : Sorted)
+      Sum += S;
+    const size_t N = Sorted.size();
+    const double Median =
+        N % 2 ? Sorted[N / 2] : (Sorted[N / 2 - 1] + Sorted[N / 2]) / 2;
+    OS << (I ? ",\n" : "\n") << "    {\"name\": \"" << R.Name
+       << "\", \"operations\": " << R.Operations
+       << format(", \"min_ms\": %.3f, \"median_ms\": %.3f, "
+                 "\"mean_ms\": %.3f, \"max_ms\": %.3f",
+                 Sorted.front() * 1000, Median * 1000, Sum / N * 1000,
+                 Sorted.back() * 1000);
+    if (R.PeakRSSGrowth >= 0)
+      OS << format(", \"peak_rss_growth_mb\": %.1f", R.PeakRSSGrowth / 1024.0);
+    OS << "}";
+  }
+  OS << "\n  ]\n"
+     << "}\n";
+}
+
+int main(int argc, const char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, BenchUsage);
+  if (!Iterations) {
+    errs() << "clang-rename-bench: -iterations must be at least 1\n";
+    return 1;
+  }
+
+  rename::ProjectShape Shape;
+  Shape.TUs = TUs;
+  Shape.Headers = Headers;
+  Shape.FanIn = FanIn;
+  Shape.Classes = Classes;
+  Shape.TemplateDepth = TemplateDepth;
+  rename::GeneratedProject Project;
+  std::string ErrorMessage;
+  if (!rename::generateProject(Directory, Shape, Project, ErrorMessage)) {
+    errs() << "clang-rename-bench: " << ErrorMessage << "\n";
+    return 1;
+  }
+
+  std::vector<Result> Results;
+  const std::string CachePath =
+      DependencyDatabase::getCachePath(Project.DatabasePath);
+  auto Load = [&]() {
+    std::unique_ptr<DependencyDatabase> DB(
+        DependencyDatabase::loadFromFile(Project.DatabasePath, ErrorMessage));
+    if (!DB)
+      errs() << "clang-rename-bench: " << ErrorMessage << "\n";
+    return bool(DB);
+  };
+  // Without its cache, the database is parsed from JSON and the cache is
+  // written; with it, the cache is only mapped. The llvm::yaml reader the
+  // JSON parser replaced is the baseline for both.
+  auto RemoveCache = [&]() { sys::fs::remove(CachePath); };
+  auto ReadWithYAML = [&]() {
+    auto JSON = MemoryBuffer::getFile(Project.DatabasePath);
+    size_t NumEntries = 0;
+    if (!JSON ||
+        !rename::readWithYAML((*JSON)->getBuffer(), NumEntries, ErrorMessage) ||
+        NumEntries != Project.Sources.size()) {
+      errs() << "clang-rename-bench: cannot read " << Project.DatabasePath
+             << " with llvm::yaml\n";
+      return false;
+    }
+    return true;
+  };
+  if (!measure(Results, "dependency database: parse with llvm::yaml "
+                        "(baseline)",
+               Project.Sources.size(), ReadWithYAML))
+    return 1;
+  measurePeakRSS(Results, ReadWithYAML);
+  if (!measure(Results, "dependency database: parse", Project.Sources.size(),
+               Load, RemoveCache))
+    return 1;
+  measurePeakRSS(Results, Load, RemoveCache);
+  if (!measure(Results, "dependency database: load cached",
+               Project.Sources.size(), Load))
+    return 1;
+  measurePeakRSS(Results, Load);
+
+  // A single translation unit, parsed once, for the lookups within it.
+  auto Code = MemoryBuffer::getFile(Project.Sources.front());
+  if (!Code) {
+    errs() << "clang-rename-bench: cannot read " << Project.Sources.front()
+           << "\n";
+    return 1;
+  }
+  SmallString<128> IncludeDir(sys::path::parent_path(Project.SymbolHeader));
+  std::vector<std::string> Args;
+  Args.push_back("-std=c++11");
+  Args.push_back("-I" + IncludeDir.str().str());
+  std::unique_ptr<ASTUnit> AST(tooling::buildASTFromCodeWithArgs(
+      (*Code)->getBuffer(), Args, Project.Sources.front()));
+  if (!AST) {
+    errs() << "clang-rename-bench: cannot parse " << Project.Sources.front()
+           << "\n";
+    return 1;
+  }
+  ASTContext &Context = AST->getASTContext();
+  const SourceManager &SourceMgr = Context.getSourceManager();
+  const SourceLocation FileStart =
+      SourceMgr.getLocForStartOfFile(SourceMgr.getMainFileID());
+
+  // Every spelling of a class name in the main file.
+  std::vector<SourceLocation> Points;
+  const StringRef Buffer = (*Code)->getBuffer();
+  for (size_t Offset = Buffer.find("Widget_"); Offset != StringRef::npos;
+       Offset = Buffer.find("Widget_", Offset + 1))
+    Points.push_back(FileStart.getLocWithOffset(Offset));
+  if (Points.empty()) {
+    errs() << "clang-rename-bench: no symbols in " << Project.Sources.front()
+           << "\n";
+    return 1;
+  }
+  if (!measure(Results, "getNamedDeclAt", Points.size(), [&]() {
+        for (const auto Point : Points) {
+          if (!rename::getNamedDeclAt(Context, Point)) {
+            errs() << "clang-rename-bench: no symbol at "
+                   << Point.printToString(SourceMgr) << "\n";
+            return false;
+          }
+        }
+        return true;
+      }))
+    return 1;
+
+  // The same lookups in an index built once, as for many points in one AST.
+  const rename::TopLevelDeclIndex Index(Context);
+  if (!measure(Results, "TopLevelDeclIndex::getNamedDeclAt", Points.size(),
+               [&]() {
+        for (const auto Point : Points)
+          if (!Index.getNamedDeclAt(Point))
+            return false;
+        return true;
+      }))
+    return 1;
+
+  const NamedDecl *Symbol = rename::getNamedDeclAt(Context, Points.front());
+  std::vector<std::string> USRs(1, rename::getUSRForDecl(Symbol));
+  if (!measure(Results, "getLocationsOfUSRs", 1, [&]() {
+        rename::USRCache Cache;
+        const rename::FileFilter Filter(SourceMgr, Symbol->getName(),
+                                        std::vector<std::string>());
+        return !rename::getLocationsOfUSRs(USRs, Symbol->getName(),
+                                           Context.getTranslationUnitDecl(),
+                                           Cache, &Filter).empty();
+      }))
+    return 1;
+  AST.reset();
+
+  // A class is searched for along with all of its constructors, see
+  // USRFindingAction. Find its occurrences with the USRs of more and more of
+  // them in the same translation unit: as every node is matched against the
+  // set of USRs at once, the time should stay flat.
+  unsigned CtorsOffset;
+  const std::string CtorsCode =
+      rename::getConstructorSource(Constructors, CtorsOffset);
+  std::unique_ptr<ASTUnit> CtorsAST(
+      tooling::buildASTFromCodeWithArgs(CtorsCode, Args, "ctors.cpp"));
+  if (!CtorsAST) {
+    errs() << "clang-rename-bench: cannot parse the constructors\n";
+    return 1;
+  }
+  ASTContext &CtorsContext = CtorsAST->getASTContext();
+  const SourceManager &CtorsSourceMgr = CtorsContext.getSourceManager();
+  const auto *Class = dyn_cast_or_null<CXXRecordDecl>(rename::getNamedDeclAt(
+      CtorsContext, CtorsSourceMgr.getLocForStartOfFile(
+                        CtorsSourceMgr.getMainFileID())
+                        .getLocWithOffset(CtorsOffset)));
+  if (!Class || !Class->getDefinition()) {
+    errs() << "clang-rename-bench: no class in the constructors\n";
+    return 1;
+  }
+  std::vector<std::string> ClassUSRs(1, rename::getUSRForDecl(Class));
+  for (const auto *Ctor : Class->getDefinition()->ctors())
+    ClassUSRs.push_back(rename::getUSRForDecl(Ctor));
+  for (size_t Count = 1;; Count *= 4) {
+    Count = std::min(Count, ClassUSRs.size());
+    const std::vector<std::string> Searched(ClassUSRs.begin(),
+                                            ClassUSRs.begin() + Count);
+    const std::string Name =
+        "getLocationsOfUSRs: " + std::to_string(Count) + " class USRs";
+    if (!measure(Results, Name, Count, [&]() {
+          rename::USRCache Cache;
+          return !rename::getLocationsOfUSRs(
+                      Searched, Class->getName(),
+                      CtorsContext.getTranslationUnitDecl(), Cache)
+                      .empty();
+        }))
+      return 1;
+    if (Count == ClassUSRs.size())
+      break;
+  }
+  CtorsAST.reset();
+
+  // The whole rename of the class in the first header, in every translation
+  // unit that includes it, without writing the files.
+  std::unique_ptr<DependencyDatabase> DB(
+      DependencyDatabase::loadFromFile(Project.DatabasePath, ErrorMessage));
+  if (!DB) {
+    errs() << "clang-rename-bench: " << ErrorMessage << "\n";
+    return 1;
+  }
+  rename::RenameOptions Options;
+  Options.NewName = "Gadget";
+  Options.Offset = Project.SymbolOffset;
+  Options.Jobs = Jobs;
+  Options.Dependents = true;
+  if (!measure(Results, "rename", Project.Sources.size(), [&]() {
+        tooling::Replacements Replaces;
+        std::string PrevName;
+        if (rename::collectReplacements(*DB, Project.SymbolHeader, Options,
+                                        Replaces, PrevName))
+          return false;
+        if (PrevName != Project.SymbolName) {
+          errs() << "clang-rename-bench: renamed " << PrevName
+                 << " instead of " << Project.SymbolName << "\n";
+          return false;
+        }
+        return !rename::applyReplacements(Replaces, /*Inplace=*/false,
+                                          Project.SymbolHeader, nulls());
+      }))
+    return 1;
+
+  const unsigned NumJobs = rename::getNumWorkers(Jobs, Project.Sources.size());
+  if (OutputPath.empty()) {
+    writeResults(outs(), Results, NumJobs);
+    return 0;
+  }
+  std::error_code EC;
+  raw_fd_ostream OS(OutputPath.c_str(), EC, sys::fs::F_Text);
+  if (EC) {
+    errs() << "clang-rename-bench: cannot write " << OutputPath << ": "
+           << EC.message() << "\n";
+    return 1;
+  }
+  writeResults(OS, Results, NumJobs);
+  return 0;
+}
@@ -0,0 +1,237 @@
+//===--- tools/extra/clang-rename/ProjectGenerator.cpp - Clang rename bench ==//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Writes synthetic C++ projects of a given shape, along with their
+/// compile_filedeps.json, for clang-rename-bench to rename in.
+///
+/// Header K declares a class template Depth_K that instantiates itself down
+/// to the template depth, and classes Widget_K_C that use it. Every source
+/// file includes header 0 and the fan-in less one headers after it, cycling
+/// through the rest, and uses each of their classes in a function of its own.
+///
+//===----------------------------------------------------------------------===//
+
+#include "ProjectGenerator.h"
+#include "../JSONWriter.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+
+using namespace llvm;
+
+namespace clang {
+namespace rename {
+
+static bool writeFile(StringRef Path, StringRef Content,
+                      std::string &ErrorMessage) {
+  std::error_code EC;
+  raw_fd_ostream OS(Path.str().c_str(), EC, sys::fs::F_Text);
+  if (!EC) {
+    OS << Content;
+    OS.close();
+    if (!OS.has_error())
+      return true;
+    OS.clear_error();
+  }
+  ErrorMessage = "cannot write " + Path.str();
+  if (EC)
+    ErrorMessage += ": " + EC.message();
+  return false;
+}
+
+// Returns the text of header K. Sets SymbolOffset to where the name of its
+// first class is spelled.
+static std::string getHeader(unsigned K, const ProjectShape &Shape,
+                             unsigned &SymbolOffset) {
+  std::string Text;
+  raw_string_ostream OS(Text);
+  OS << "#ifndef BENCH_HEADER_" << K << "_H\n"
+     << "#define BENCH_HEADER_" << K << "_H\n\n"
+     << "namespace bench {\n\n"
+     << "template <int N> struct Depth_" << K << " {\n"
+     << "  typedef typename Depth_" << K << "<N - 1>::Type Type;\n"
+     << "  static int value() { return Depth_" << K
+     << "<N - 1>::value() + N; }\n"
+     << "};\n\n"
+     << "template <> struct Depth_" << K << "<0> {\n"
+     << "  typedef int Type;\n"
+     << "  static int value() { return 0; }\n"
+     << "};\n";
+
+  for (unsigned C = 0; C != Shape.Classes; ++C) {
+    const std::string Name = "Widget_" + std::to_string(K) + "_" +
+                             std::to_string(C);
+    OS << "\nclass ";
+    if (C == 0) {
+      OS.flush();
+      SymbolOffset = Text.size();
+    }
+    OS << Name << " {\n"
+       << "public:\n"
+       << "  " << Name << "() : Value(0) {}\n"
+       << "  explicit " << Name << "(int Value) : Value(Value) {}\n"
+       << "  int get() const {\n"
+       << "    return Value + Depth_" << K << "<" << Shape.TemplateDepth
+       << ">::value();\n"
+       << "  }\n"
+       << "  void set(int V) { Value = V; }\n"
+       << "  " << Name << " combine(const " << Name << " &Other) const {\n"
+       << "    return " << Name << "(Value + Other.Value);\n"
+       << "  }\n\n"
+       << "private:\n"
+       << "  int Value;\n"
+       << "};\n";
+  }
+
+  OS << "\n} // namespace bench\n\n"
+     << "#endif\n";
+  return OS.str();
+}
+
+// Returns the text of source file T, which includes Headers.
+static std::string getSource(unsigned T, ArrayRef<unsigned> Headers,
+                             const ProjectShape &Shape) {
+  std::string Text;
+  raw_string_ostream OS(Text);
+  for (unsigned K : Headers)
+    OS << "#include \"header_" << K << ".h\"\n";
+
+  for (unsigned K : Headers) {
+    OS << "\nint use_" << T << "_" << K << "(int Seed) {\n"
+       << "  int Sum = 0;\n";
+    for (unsigned C = 0; C != Shape.Classes; ++C) {
+      const std::string Name = "Widget_" + std::to_string(K) + "_" +
+                               std::to_string(C);
+      OS << "  bench::" << Name << " W" << C << "(Seed);\n"
+         << "  W" << C << ".set(Sum);\n"
+         << "  Sum += W" << C << ".combine(W" << C << ").get();\n";
+    }
+    OS << "  return Sum;\n"
+       << "}\n";
+  }
+  return OS.str();
+}
+
+bool generateProject(StringRef Directory, const ProjectShape &Shape,
+                     GeneratedProject &Project, std::string &ErrorMessage) {
+  if (!Shape.TUs || !Shape.Headers || !Shape.Classes) {
+    ErrorMessage = "a project needs at least one source file, header and "
+                   "class";
+    return false;
+  }
+
+  SmallString<128> Root(Directory);
+  sys::fs::make_absolute(Root);
+  SmallString<128> IncludeDir(Root), SourceDir(Root);
+  sys::path::append(IncludeDir, "include");
+  sys::path::append(SourceDir, "src");
+  for (StringRef Dir : { IncludeDir.str(), SourceDir.str() }) {
+    if (std::error_code EC = sys::fs::create_directories(Dir)) {
+      ErrorMessage = "cannot create " + Dir.str() + ": " + EC.message();
+      return false;
+    }
+  }
+
+  std::vector<std::string> HeaderPaths;
+  for (unsigned K = 0; K != Shape.Headers; ++K) {
+    SmallString<128> Path(IncludeDir);
+    sys::path::append(Path, "header_" + Twine(K) + ".h");
+    unsigned SymbolOffset = 0;
+    if (!writeFile(Path, getHeader(K, Shape, SymbolOffset), ErrorMessage))
+      return false;
+    HeaderPaths.push_back(Path.str());
+    if (K == 0) {
+      Project.SymbolHeader = Path.str();
+      Project.SymbolName = "Widget_0_0";
+      Project.SymbolOffset = SymbolOffset;
+    }
+  }
+
+  const unsigned FanIn = std::max(1u, std::min(Shape.FanIn, Shape.Headers));
+  std::vector<std::vector<unsigned>> Includes(Shape.TUs);
+  Project.Sources.clear();
+  for (unsigned T = 0; T != Shape.TUs; ++T) {
+    // Header 0 and a window of the others that slides by the fan-in, so that
+    // every header is included by about as many source files.
+    Includes[T].push_back(0);
+    for (unsigned J = 1; J != FanIn; ++J)
+      Includes[T].push_back(1 + (T * (FanIn - 1) + J - 1) %
+                                    (Shape.Headers - 1));
+
+    SmallString<128> Path(SourceDir);
+    sys::path::append(Path, "tu_" + Twine(T) + ".cpp");
+    if (!writeFile(Path, getSource(T, Includes[T], Shape), ErrorMessage))
+      return false;
+    Project.Sources.push_back(Path.str());
+  }
+
+  SmallString<128> DatabasePath(Root);
+  sys::path::append(DatabasePath, "compile_filedeps.json");
+  std::string Database;
+  {
+    raw_string_ostream OS(Database);
+    OS << "[";
+    for (unsigned T = 0; T != Shape.TUs; ++T) {
+      OS << (T ? ",\n" : "\n") << "  {\n    \"directory\": ";
+      writeJSONString(OS, Root);
+      OS << ",\n    \"command\": ";
+      writeJSONString(OS, "c++ -std=c++11 -Iinclude -c src/tu_" +
+                              Twine(T).str() + ".cpp -o tu_" +
+                              Twine(T).str() + ".o");
+      OS << ",\n    \"file\": ";
+      writeJSONString(OS, Project.Sources[T]);
+      OS << ",\n    \"deps\": [";
+      for (size_t J = 0, F = Includes[T].size(); J != F; ++J) {
+        OS << (J ? ", " : "");
+        writeJSONString(OS, HeaderPaths[Includes[T][J]]);
+      }
+      OS << "]\n  }";
+    }
+    OS << "\n]\n";
+  }
+  if (!writeFile(DatabasePath, Database, ErrorMessage))
+    return false;
+  Project.DatabasePath = DatabasePath.str();
+  return true;
+}
+
+
+std::string getConstructorSource(unsigned Constructors,
+                                 unsigned &SymbolOffset) {
+  std::string Text;
+  raw_string_ostream OS(Text);
+  for (unsigned I = 0; I != Constructors; ++I)
+    OS << "struct Tag_" << I << " {};\n";
+  OS << "\nclass ";
+  SymbolOffset = OS.tell();
+  OS << "Ctors {\npublic:\n";
+  for (unsigned I = 0; I != Constructors; ++I)
+    OS << "  explicit Ctors(Tag_" << I << ") : Value(" << I << ") {}\n";
+  OS << "  int get() const { return Value; }\n\n"
+     << "private:\n"
+     << "  int Value;\n"
+     << "};\n";
+  for (unsigned I = 0; I != Constructors; ++I)
+    OS << "\nint use_" << I << "() {\n"
+       << "  Ctors C = Ctors(Tag_" << I << "());\n"
+       << "  Ctors *P = new Ctors(Tag_" << I << "());\n"
+       << "  int Result = C.get() + P->get();\n"
+       << "  delete P;\n"
+       << "  return Result;\n"
+       << "}\n";
+  return OS.str();
+}
+
+}
+}
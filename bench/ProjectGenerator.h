@@ -0,0 +1,74 @@
+//===--- tools/extra/clang-rename/ProjectGenerator.h - Clang rename bench -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Writes synthetic C++ projects of a given shape, along with their
+/// compile_filedeps.json, for clang-rename-bench to rename in.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_PROJECT_GENERATOR_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_PROJECT_GENERATOR_H
+
+#include "llvm/ADT/StringRef.h"
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace rename {
+
+// The size of a generated project.
+struct ProjectShape {
+  ProjectShape()
+      : TUs(100), Headers(20), FanIn(5), Classes(10), TemplateDepth(3) {
+  }
+
+  // Source files, each compiled on its own.
+  unsigned TUs;
+  // Headers shared between the source files.
+  unsigned Headers;
+  // Headers included by every source file. The first header is always among
+  // them, so that the symbol renamed lives in every translation unit.
+  unsigned FanIn;
+  // Classes declared in, and used from every includer of, each header.
+  unsigned Classes;
+  // How deeply the class template of each header instantiates itself.
+  unsigned TemplateDepth;
+};
+
+// What was written by generateProject.
+struct GeneratedProject {
+  // The compile_filedeps.json of the project.
+  std::string DatabasePath;
+  // The source files, in order.
+  std::vector<std::string> Sources;
+  // The first header, which declares SymbolName at SymbolOffset. The symbol
+  // is a class referred to from every source file.
+  std::string SymbolHeader;
+  std::string SymbolName;
+  unsigned SymbolOffset;
+};
+
+// Writes a project of the given shape into Directory, overwriting the files
+// of any project generated there before. Returns false and sets ErrorMessage
+// on failure.
+bool generateProject(llvm::StringRef Directory, const ProjectShape &Shape,
+                     GeneratedProject &Project, std::string &ErrorMessage);
+
+// Returns a source file declaring a class Ctors with the given number of
+// constructors, each called from a function of its own, so that finding the
+// occurrences of the class searches for as many constructor USRs. Sets
+// SymbolOffset to where the name of the class is spelled first.
+std::string getConstructorSource(unsigned Constructors,
+                                 unsigned &SymbolOffset);
+
+}
+}
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_PROJECT_GENERATOR_H
@@ -0,0 +1,141 @@
+//===--- tools/extra/clang-rename/YAMLBaseline.cpp - Clang rename bench ---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief The llvm::yaml reading of compile_filedeps.json that JSONReader
+/// replaced, kept for clang-rename-bench to compare against.
+///
+//===----------------------------------------------------------------------===//
+
+#include "YAMLBaseline.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/YAMLParser.h"
+#include <vector>
+
+using namespace llvm;
+
+namespace clang {
+namespace rename {
+
+namespace {
+struct YAMLEntry {
+  std::string File;
+  std::string Directory;
+  std::string Command;
+  std::vector<std::string> Deps;
+};
+} // end namespace
+
+static std::string getNativePath(yaml::ScalarNode *File,
+                                 yaml::ScalarNode *Directory) {
+  SmallString<16> FileStorage;
+  StringRef FileName = File->getValue(FileStorage);
+  SmallString<128> NativeFilePath;
+  if (sys::path::is_relative(FileName)) {
+    SmallString<8> DirectoryStorage;
+    SmallString<128> AbsolutePath(Directory->getValue(DirectoryStorage));
+    sys::path::append(AbsolutePath, FileName);
+    sys::path::native(AbsolutePath.str(), NativeFilePath);
+  } else {
+    sys::path::native(FileName, NativeFilePath);
+  }
+  return NativeFilePath.str();
+}
+
+bool readWithYAML(StringRef JSON, size_t &NumEntries,
+                  std::string &ErrorMessage) {
+  SourceMgr SM;
+  yaml::Stream YAMLStream(JSON, SM);
+  yaml::document_iterator I = YAMLStream.begin();
+  if (I == YAMLStream.end() || !I->getRoot()) {
+    ErrorMessage = "Error while parsing YAML.";
+    return false;
+  }
+  auto *Array = dyn_cast<yaml::SequenceNode>(I->getRoot());
+  if (!Array) {
+    ErrorMessage = "Expected array.";
+    return false;
+  }
+
+  std::vector<YAMLEntry> Entries;
+  for (auto AI = Array->begin(), AE = Array->end(); AI != AE; ++AI) {
+    auto *Object = dyn_cast<yaml::MappingNode>(&*AI);
+    if (!Object) {
+      ErrorMessage = "Expected object.";
+      return false;
+    }
+    yaml::ScalarNode *Directory = nullptr;
+    yaml::ScalarNode *Command = nullptr;
+    yaml::ScalarNode *File = nullptr;
+    SmallVector<yaml::ScalarNode *, 8> Deps;
+    for (auto KVI = Object->begin(), KVE = Object->end(); KVI != KVE; ++KVI) {
+      yaml::Node *Value = (*KVI).getValue();
+      auto *KeyString = dyn_cast_or_null<yaml::ScalarNode>((*KVI).getKey());
+      if (!Value || !KeyString) {
+        ErrorMessage = "Expected a string key and a value.";
+        return false;
+      }
+
+      SmallString<8> KeyStorage;
+      const StringRef Key = KeyString->getValue(KeyStorage);
+      if (auto *Sequence = dyn_cast<yaml::SequenceNode>(Value)) {
+        if (Key != "deps") {
+          ErrorMessage = ("Unknown key: \"" + Key + "\"").str();
+          return false;
+        }
+        for (auto DI = Sequence->begin(), DE = Sequence->end(); DI != DE;
+             ++DI) {
+          auto *Node = dyn_cast<yaml::ScalarNode>(&*DI);
+          if (!Node) {
+            ErrorMessage = "Expecting string values in dependency sequence.";
+            return false;
+          }
+          Deps.push_back(Node);
+        }
+      } else if (auto *ValueString = dyn_cast<yaml::ScalarNode>(Value)) {
+        if (Key == "directory") {
+          Directory = ValueString;
+        } else if (Key == "command") {
+          Command = ValueString;
+        } else if (Key == "file") {
+          File = ValueString;
+        } else {
+          ErrorMessage = ("Unknown key: \"" + Key + "\"").str();
+          return false;
+        }
+      } else {
+        ErrorMessage = "Expected string or sequence value.";
+        return false;
+      }
+    }
+    if (!File || !Command || !Directory) {
+      ErrorMessage = "Missing key.";
+      return false;
+    }
+
+    YAMLEntry Entry;
+    Entry.File = getNativePath(File, Directory);
+    for (auto *Dep : Deps)
+      Entry.Deps.push_back(getNativePath(Dep, Directory));
+    SmallString<8> DirectoryStorage;
+    Entry.Directory = Directory->getValue(DirectoryStorage);
+    SmallString<1024> CommandStorage;
+    Entry.Command = Command->getValue(CommandStorage);
+    Entries.push_back(std::move(Entry));
+  }
+  NumEntries = Entries.size();
+  return true;
+}
+
+}
+}
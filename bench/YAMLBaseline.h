@@ -0,0 +1,41 @@
+//===--- tools/extra/clang-rename/YAMLBaseline.h - Clang rename bench -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief The llvm::yaml reading of compile_filedeps.json that JSONReader
+/// replaced, kept for clang-rename-bench to compare against.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_YAML_BASELINE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_YAML_BASELINE_H
+
+#include "llvm/ADT/StringRef.h"
+#include <cstddef>
+#include <string>
+
+namespace clang {
+namespace rename {
+
+// Reads the entries of the JSON database as DependencyDatabase did before
+// JSONReader: the document is parsed into a llvm::yaml node tree, and every
+// entry is copied out of it with its paths made native and absolute. All
+// entries are held until the end, as the old loader held them while it built
+// the binary database. Building it is not reproduced, so the time and memory
+// this takes are a lower bound of the old parse.
+//
+// Sets NumEntries to the entries read. Returns false and sets ErrorMessage
+// if the database is malformed.
+bool readWithYAML(llvm::StringRef JSON, size_t &NumEntries,
+                  std::string &ErrorMessage);
+
+}
+}
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_YAML_BASELINE_H
@@ -54,4 +54,30 @@ project "clang-rename"
         "clangBasic",
         "clangIndex",
         "LLVM-"..llvm_version,
+        "pthread",
+    }
+
+project "clang-rename-bench"
+    includedirs "./"
+    language "C++"
+    kind "ConsoleApp"
+    files { "bench/*.cpp" }
+    links {
+        "clangRename",
+        "clangTooling",
+        "clangFrontend",
+        "clangSerialization",
+        "clangParse",
+        "clangSema",
+        "clangAnalysis",
+        "clangEdit",
+        "clangRewrite",
+        "clangDriver",
+        "clangAST",
+        "clangASTMatchers",
+        "clangLex",
+        "clangBasic",
+        "clangIndex",
+        "LLVM-"..llvm_version,
+        "pthread",
     }
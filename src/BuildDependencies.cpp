@@ -0,0 +1,309 @@
+//===----------------------------------------------------------------------===//
+//
+// The Ninja deps log (version 3 or 4) starts with the line "# ninjadeps",
+// followed by a 32-bit version and a sequence of records. Every record starts
+// with its size as a 32-bit word whose top bit tells dependency records from
+// path records:
+//
+//   path:       the path, NUL-padded to a multiple of four bytes, and, since
+//               version 4, the complement of the ID the path is given
+//   dependency: the ID of the output, its modification time (32 bits of
+//               seconds before version 4, 64 bits of nanoseconds since),
+//               and the IDs of its inputs
+//
+// Paths are numbered in the order they are recorded. A later dependency
+// record of an output replaces the earlier ones. All words are in host byte
+// order and paths are relative to the build directory unless absolute.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BuildDependencies.h"
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <cstring>
+#include <memory>
+
+using namespace llvm;
+using namespace clang::tooling;
+
+// Makes Path absolute against Base and removes "." and ".." components, so
+// that the paths of the build and of the compile commands compare equal.
+static std::string getNormalPath(StringRef Base, StringRef Path) {
+  SmallString<256> Absolute;
+  if (sys::path::is_absolute(Path)) {
+    Absolute = Path;
+  } else {
+    Absolute = Base;
+    sys::path::append(Absolute, Path);
+  }
+  sys::fs::make_absolute(Absolute);
+
+  SmallVector<StringRef, 16> Components;
+  StringRef Str = Absolute.str();
+  for (auto I = sys::path::begin(Str), E = sys::path::end(Str); I != E; ++I) {
+    if (*I == ".")
+      continue;
+    if (*I == "..") {
+      if (Components.size() > 1)
+        Components.pop_back();
+      continue;
+    }
+    Components.push_back(*I);
+  }
+  SmallString<256> Result;
+  for (const auto &Component : Components)
+    sys::path::append(Result, Component);
+  return Result.str();
+}
+
+// Returns the modification time of the file Status is of, in nanoseconds.
+static uint64_t getModificationTime(const sys::fs::file_status &Status) {
+  const auto Modified = Status.getLastModificationTime();
+  return Modified.toEpochTime() * 1000000000 + Modified.nanoseconds();
+}
+
+BuildDependencies::BuildDependencies(StringRef BuildPath,
+                                     std::string &ErrorMessage)
+    : BuildPath(BuildPath) {
+  SmallString<256> LogPath(BuildPath);
+  sys::path::append(LogPath, ".ninja_deps");
+  if (sys::fs::exists(LogPath.str()))
+    readNinjaDeps(LogPath, ErrorMessage);
+}
+
+bool BuildDependencies::readNinjaDeps(StringRef Path,
+                                      std::string &ErrorMessage) {
+  auto Buffer = MemoryBuffer::getFile(Path, /*FileSize=*/-1,
+                                      /*RequiresNullTerminator=*/false);
+  if (!Buffer) {
+    ErrorMessage = "Error while opening " + Path.str() + ": " +
+                   Buffer.getError().message();
+    return false;
+  }
+
+  static const char Signature[] = "# ninjadeps\n";
+  const size_t SignatureSize = sizeof(Signature) - 1;
+  const char *Data = (*Buffer)->getBufferStart();
+  const char *End = (*Buffer)->getBufferEnd();
+  auto readWord = [](const char *P) {
+    uint32_t Word;
+    memcpy(&Word, P, sizeof(Word));
+    return Word;
+  };
+
+  if (size_t(End - Data) < SignatureSize + 4 ||
+      memcmp(Data, Signature, SignatureSize) != 0) {
+    ErrorMessage = "Not a Ninja deps log: " + Path.str();
+    return false;
+  }
+  const uint32_t Version = readWord(Data + SignatureSize);
+  if (Version != 3 && Version != 4) {
+    ErrorMessage = "Unsupported Ninja deps log version in " + Path.str();
+    return false;
+  }
+  const unsigned TimeWords = Version == 3 ? 1 : 2;
+
+  // Ninja truncates a record it was interrupted writing the next time it
+  // runs; a truncated record ends the log here as well.
+  for (const char *P = Data + SignatureSize + 4; End - P >= 4;) {
+    uint32_t Size = readWord(P);
+    const bool IsDependencies = Size & 0x80000000;
+    Size &= 0x7FFFFFFF;
+    P += 4;
+    if (Size % 4 != 0 || size_t(End - P) < Size)
+      break;
+
+    if (IsDependencies) {
+      const unsigned HeaderWords = 1 + TimeWords;
+      if (Size < HeaderWords * 4)
+        break;
+      const uint32_t Output = readWord(P);
+      if (Output >= NinjaPaths.size())
+        break;
+      auto &Record = NinjaDeps[NinjaPaths[Output]];
+      if (Version == 3)
+        Record.Time = uint64_t(readWord(P + 4)) * 1000000000;
+      else
+        Record.Time = readWord(P + 4) | uint64_t(readWord(P + 8)) << 32;
+      Record.Inputs.clear();
+      for (unsigned I = HeaderWords, E = Size / 4; I != E; ++I)
+        Record.Inputs.push_back(readWord(P + I * 4));
+    } else {
+      unsigned PathSize = Size;
+      if (Version >= 4) {
+        if (PathSize < 4)
+          break;
+        PathSize -= 4;
+      }
+      while (PathSize && P[PathSize - 1] == '\0')
+        --PathSize;
+      NinjaPaths.push_back(getNormalPath(BuildPath, StringRef(P, PathSize)));
+    }
+    P += Size;
+  }
+
+  // Inputs naming paths recorded after the log was cut short are dropped
+  // along with their object.
+  for (auto &Entry : NinjaDeps) {
+    auto &Inputs = Entry.getValue().Inputs;
+    for (uint32_t Input : Inputs) {
+      if (Input >= NinjaPaths.size()) {
+        Inputs.clear();
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+bool BuildDependencies::isModifiedAfter(const std::string &Path,
+                                        uint64_t Time) const {
+  auto It = ModificationTimes.find(Path);
+  if (It != ModificationTimes.end())
+    return It->getValue() > Time;
+
+  uint64_t Modified = ~0ULL;
+  sys::fs::file_status Status;
+  if (!sys::fs::status(Path, Status))
+    Modified = getModificationTime(Status);
+  ModificationTimes[Path] = Modified;
+  return Modified > Time;
+}
+
+// Reads the prerequisites of the first rule of the Makefile fragment at Path
+// into Dependencies, unescaped and relative to Directory.
+static bool readDepFile(StringRef Path, StringRef Directory,
+                        std::vector<std::string> &Dependencies) {
+  auto Buffer = MemoryBuffer::getFile(Path);
+  if (!Buffer)
+    return false;
+  const StringRef Text = (*Buffer)->getBuffer();
+
+  // Skip the targets. A colon followed by a path separator belongs to a
+  // drive letter, not to the rule.
+  size_t I = 0;
+  for (; I != Text.size(); ++I) {
+    if (Text[I] == '\\' && I + 1 != Text.size()) {
+      ++I;
+    } else if (Text[I] == ':' &&
+               (I + 1 == Text.size() ||
+                (Text[I + 1] != '\\' && Text[I + 1] != '/'))) {
+      break;
+    }
+  }
+  if (I == Text.size())
+    return false;
+
+  std::string Dependency;
+  auto finish = [&]() {
+    if (!Dependency.empty())
+      Dependencies.push_back(getNormalPath(Directory, Dependency));
+    Dependency.clear();
+  };
+  for (++I; I != Text.size(); ++I) {
+    const char C = Text[I];
+    if (C == '\\' && I + 1 != Text.size()) {
+      const char Next = Text[I + 1];
+      if (Next == '\n' || Next == '\r') {
+        // A line continuation.
+        finish();
+        ++I;
+        if (Next == '\r' && I + 1 != Text.size() && Text[I + 1] == '\n')
+          ++I;
+        continue;
+      }
+      if (Next == ' ' || Next == '#' || Next == '\\') {
+        Dependency += Next;
+        ++I;
+        continue;
+      }
+      Dependency += C;
+    } else if (C == '$' && I + 1 != Text.size() && Text[I + 1] == '$') {
+      Dependency += '$';
+      ++I;
+    } else if (C == ' ' || C == '\t') {
+      finish();
+    } else if (C == '\n' || C == '\r') {
+      break;
+    } else {
+      Dependency += C;
+    }
+  }
+  finish();
+  return true;
+}
+
+// Returns the value of the option Name in CommandLine, given either joined
+// or as the next argument, or an empty string.
+static StringRef getOptionValue(ArrayRef<std::string> CommandLine,
+                                StringRef Name) {
+  StringRef Value;
+  for (size_t I = 0, E = CommandLine.size(); I != E; ++I) {
+    const StringRef Argument = CommandLine[I];
+    if (Argument == Name && I + 1 != E)
+      Value = CommandLine[++I];
+    else if (Argument.startswith(Name) && Argument.size() > Name.size())
+      Value = Argument.substr(Name.size());
+  }
+  return Value;
+}
+
+bool BuildDependencies::getDependencies(
+    const CompileCommand &Command, StringRef MainFile,
+    std::vector<std::string> &Dependencies) const {
+  Dependencies.clear();
+  const StringRef Output = getOptionValue(Command.CommandLine, "-o");
+  const std::string MainPath = getNormalPath(Command.Directory, MainFile);
+
+  std::vector<std::string> Found;
+  // When the dependencies were recorded, in nanoseconds.
+  uint64_t Recorded = 0;
+  bool Known = false;
+  if (!Output.empty() && !NinjaDeps.empty()) {
+    auto I = NinjaDeps.find(getNormalPath(Command.Directory, Output));
+    if (I != NinjaDeps.end() && !I->getValue().Inputs.empty()) {
+      for (uint32_t Input : I->getValue().Inputs)
+        Found.push_back(NinjaPaths[Input]);
+      Recorded = I->getValue().Time;
+      Known = true;
+    }
+  }
+
+  if (!Known) {
+    // -MD and -MMD write next to the object unless -MF says otherwise.
+    std::string DepFile = getOptionValue(Command.CommandLine, "-MF");
+    if (DepFile.empty() && !Output.empty()) {
+      SmallString<256> Path(Output);
+      sys::path::replace_extension(Path, "d");
+      DepFile = Path.str();
+    }
+    if (DepFile.empty())
+      return false;
+    const std::string DepPath = getNormalPath(Command.Directory, DepFile);
+    Known = readDepFile(DepPath, Command.Directory, Found);
+    if (Known) {
+      sys::fs::file_status Status;
+      if (sys::fs::status(DepPath, Status))
+        return false;
+      Recorded = getModificationTime(Status);
+    }
+  }
+  if (!Known)
+    return false;
+
+  // A file edited since the build may include files the record lacks.
+  if (isModifiedAfter(MainPath, Recorded))
+    return false;
+  for (const auto &Path : Found)
+    if (isModifiedAfter(Path, Recorded))
+      return false;
+
+  for (auto &Path : Found)
+    if (Path != MainPath)
+      Dependencies.push_back(std::move(Path));
+  return true;
+}
@@ -0,0 +1,63 @@
+#ifndef CLANG_RENAME_BUILDDEPENDENCIES_H
+#define CLANG_RENAME_BUILDDEPENDENCIES_H
+
+#include <clang/Tooling/CompilationDatabase.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// \brief The files every object depended on when it was last built, as
+/// recorded by the build itself.
+///
+/// Ninja keeps the dependencies of all objects in the binary log .ninja_deps
+/// in its build directory; other builds leave a Makefile fragment next to
+/// each object, written by the compiler's -MD or -MMD option. Either is used
+/// to list the headers of a compile command without preprocessing it again.
+class BuildDependencies {
+public:
+  /// \brief Reads BuildPath/.ninja_deps if there is one. Dependency files are
+  /// only read when a compile command is looked up.
+  ///
+  /// Sets ErrorMessage if the Ninja deps log exists but cannot be read.
+  BuildDependencies(llvm::StringRef BuildPath, std::string &ErrorMessage);
+
+  /// \brief Sets Dependencies to the absolute paths of the files Command
+  /// depended on, other than MainFile itself.
+  ///
+  /// Returns false if the build did not record the dependencies of Command,
+  /// e.g. because its object has not been built yet, or if the record is
+  /// older than MainFile or one of the files listed, which may have been
+  /// edited to include others since.
+  bool getDependencies(const clang::tooling::CompileCommand &Command,
+                       llvm::StringRef MainFile,
+                       std::vector<std::string> &Dependencies) const;
+
+private:
+  // The dependencies of an object in the Ninja deps log.
+  struct NinjaRecord {
+    // The modification time of the object when they were recorded, in
+    // nanoseconds.
+    uint64_t Time;
+    std::vector<uint32_t> Inputs;
+  };
+
+  bool readNinjaDeps(llvm::StringRef Path, std::string &ErrorMessage);
+
+  // Returns whether the file at Path was modified after Time, in
+  // nanoseconds, or is gone.
+  bool isModifiedAfter(const std::string &Path, uint64_t Time) const;
+
+  std::string BuildPath;
+  // The absolute paths of the Ninja deps log, by ID.
+  std::vector<std::string> NinjaPaths;
+  // The dependencies of every object in the Ninja deps log, keyed by the
+  // object's absolute path.
+  llvm::StringMap<NinjaRecord> NinjaDeps;
+  // The modification times of the files looked at so far, as most headers
+  // are listed for many objects; ~0 for files that are gone.
+  mutable llvm::StringMap<uint64_t> ModificationTimes;
+};
+
+#endif
@@ -1,13 +1,55 @@
+//===----------------------------------------------------------------------===//
+//
+// The binary database is a sequence of little-endian 32-bit words:
+//
+//   header:               magic, version, JSON size, JSON modification time,
+//                         #files, #entries, #command lines, #arguments,
+//                         #dependencies, #reverse dependency words,
+//                         size of the string table
+//   files:                (#files + 1) x (path, first entry,
+//                                         first reverse dependency word)
+//   entries:              (#entries + 1) x (file, directory, command line,
+//                                           first dependency)
+//   command lines:        (#command lines + 1) x first argument
+//   arguments:            #arguments x argument
+//   dependencies:         #dependencies x file
+//   reverse dependencies: #reverse dependency words x word
+//
+// followed by the NUL-terminated strings the tables refer to by offset. The
+// JSON size and time take two words, low word first. Files are sorted by
+// path, entries by file. The last file, entry and command line are
+// sentinels, so that the rows of record I always end where those of I + 1
+// begin.
+//
+// Every string is stored once, and so is every command line: entries that
+// are compiled the same way share their command line.
+//
+// The entries depending on a file are stored as a sorted list of entries, or,
+// if that takes more words, as a bitmap with one bit per entry; the top bit
+// of the first word of the file's reverse dependencies tells which. A few
+// headers are included almost everywhere, and their bitmaps are a fraction
+// of the size of the lists and are combined a word at a time.
+//
+//===----------------------------------------------------------------------===//
+
 #include "DependencyDatabase.h"
 #include "DependencyDatabasePlugin.h"
+#include "JSONReader.h"
 
 #include <clang/Tooling/CompilationDatabase.h>
 #include <clang/Tooling/CompilationDatabasePluginRegistry.h>
 #include <clang/Tooling/Tooling.h>
 #include <llvm/ADT/SmallString.h>
 #include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MathExtras.h>
 #include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+#include <algorithm>
 #include <system_error>
+#include <thread>
 
 using namespace clang;
 using namespace clang::tooling; 
@@ -130,229 +172,705 @@ clang::rename::registerDependencyDatabasePlugin() {
       "Reads JSON formatted compilation databases with file dependencies");
 }
 
-namespace llvm {
-  template<>
-  struct DenseMapInfo<StringRef> {
-    // This assumes that "" will never be a valid key.
-    static inline StringRef getEmptyKey() { return StringRef(""); }
-    static inline StringRef getTombstoneKey() { return StringRef(); }
-    static unsigned getHashValue(StringRef Val) { return HashString(Val); }
-    static bool isEqual(StringRef LHS, StringRef RHS) { return LHS == RHS; }
+static const uint32_t DatabaseMagic = 0x42445243; // "CRDB"
+static const uint32_t DatabaseVersion = 3;
+static const unsigned HeaderSize = 13;
+// Marks the reverse dependencies of a file that are stored as a bitmap.
+static const uint32_t BitmapFlag = 0x80000000;
+
+namespace {
+/// \brief Collects the database while the JSON is parsed and lays it out.
+class DatabaseBuilder {
+public:
+  /// \brief Interns S and returns its offset in the string table.
+  uint32_t addString(StringRef S) {
+    auto &Entry = StringOffsets.GetOrCreateValue(S, Strings.size());
+    if (Entry.getValue() == Strings.size()) {
+      Strings.append(S.begin(), S.end());
+      Strings.push_back('\0');
+    }
+    return Entry.getValue();
+  }
+
+  uint32_t addFile(StringRef Path) {
+    auto &Entry = FileIDs.GetOrCreateValue(Path, Files.size());
+    if (Entry.getValue() == Files.size())
+      Files.push_back(std::make_pair(Entry.getKey(), addString(Path)));
+    return Entry.getValue();
+  }
+
+  void addEntry(uint32_t File, uint32_t Directory,
+                ArrayRef<std::string> CommandLine,
+                ArrayRef<uint32_t> Deps) {
+    EntryRecord Entry = { File, Directory, addCommandLine(CommandLine),
+                          uint32_t(Dependencies.size()) };
+    Entries.push_back(Entry);
+    Dependencies.insert(Dependencies.end(), Deps.begin(), Deps.end());
+  }
+
+  /// \brief Returns the binary database.
+  std::string finish(uint64_t JSONSize, uint64_t JSONTime) const;
+
+private:
+  struct EntryRecord {
+    uint32_t File, Directory, CommandLine, FirstDependency;
   };
+
+  /// \brief Interns the arguments of CommandLine, then the sequence of them.
+  uint32_t addCommandLine(ArrayRef<std::string> CommandLine) {
+    SmallVector<uint32_t, 64> Offsets;
+    for (const auto &Argument : CommandLine)
+      Offsets.push_back(addString(Argument));
+    StringRef Key(reinterpret_cast<const char *>(Offsets.data()),
+                  Offsets.size() * sizeof(uint32_t));
+    auto &Entry = CommandLineIDs.GetOrCreateValue(Key, CommandLines.size());
+    if (Entry.getValue() == CommandLines.size()) {
+      CommandLines.push_back(Arguments.size());
+      Arguments.insert(Arguments.end(), Offsets.begin(), Offsets.end());
+    }
+    return Entry.getValue();
+  }
+
+  llvm::StringMap<uint32_t> StringOffsets;
+  std::string Strings;
+  llvm::StringMap<uint32_t> FileIDs;
+  // The path and its string offset of every file, by ID.
+  std::vector<std::pair<StringRef, uint32_t>> Files;
+  std::vector<EntryRecord> Entries;
+  llvm::StringMap<uint32_t> CommandLineIDs;
+  // The first argument of every command line.
+  std::vector<uint32_t> CommandLines;
+  std::vector<uint32_t> Arguments;
+  std::vector<uint32_t> Dependencies;
+};
+
+class Words {
+public:
+  void add(uint32_t Word) {
+    const char Bytes[] = { char(Word), char(Word >> 8), char(Word >> 16),
+                           char(Word >> 24) };
+    Data.append(Bytes, sizeof(Bytes));
+  }
+
+  void add64(uint64_t Value) {
+    add(uint32_t(Value));
+    add(uint32_t(Value >> 32));
+  }
+
+  std::string Data;
+};
+} // end namespace
+
+std::string DatabaseBuilder::finish(uint64_t JSONSize,
+                                    uint64_t JSONTime) const {
+  const uint32_t NumFiles = Files.size();
+  const uint32_t NumEntries = Entries.size();
+
+  // Number files by path and order entries by file.
+  std::vector<uint32_t> FileOrder(NumFiles);
+  for (uint32_t I = 0; I != NumFiles; ++I)
+    FileOrder[I] = I;
+  std::sort(FileOrder.begin(), FileOrder.end(),
+            [this](uint32_t L, uint32_t R) {
+    return Files[L].first < Files[R].first;
+  });
+  std::vector<uint32_t> SortedFile(NumFiles);
+  for (uint32_t I = 0; I != NumFiles; ++I)
+    SortedFile[FileOrder[I]] = I;
+
+  std::vector<uint32_t> EntryOrder(NumEntries);
+  for (uint32_t I = 0; I != NumEntries; ++I)
+    EntryOrder[I] = I;
+  std::stable_sort(EntryOrder.begin(), EntryOrder.end(),
+                   [&](uint32_t L, uint32_t R) {
+    return SortedFile[Entries[L].File] < SortedFile[Entries[R].File];
+  });
+
+  auto getDependenciesEnd = [this](uint32_t Entry) -> uint32_t {
+    if (Entry + 1 == Entries.size())
+      return Dependencies.size();
+    return Entries[Entry + 1].FirstDependency;
+  };
+
+  // Count the entries and dependents of every file.
+  std::vector<uint32_t> FirstEntry(NumFiles + 1, 0);
+  std::vector<uint32_t> FirstReverse(NumFiles + 1, 0);
+  for (const auto &Entry : Entries)
+    ++FirstEntry[SortedFile[Entry.File] + 1];
+  for (auto Dep : Dependencies)
+    ++FirstReverse[SortedFile[Dep] + 1];
+  for (uint32_t I = 0; I != NumFiles; ++I) {
+    FirstEntry[I + 1] += FirstEntry[I];
+    FirstReverse[I + 1] += FirstReverse[I];
+  }
+
+  // Entries are renumbered in their new order, and their dependencies along
+  // with them.
+  std::vector<uint32_t> SortedDependencies;
+  std::vector<uint32_t> FirstDependency(NumEntries + 1);
+  std::vector<uint32_t> Reverse(Dependencies.size());
+  std::vector<uint32_t> NextReverse(FirstReverse.begin(), FirstReverse.end());
+  for (uint32_t I = 0; I != NumEntries; ++I) {
+    const uint32_t Original = EntryOrder[I];
+    FirstDependency[I] = SortedDependencies.size();
+    for (uint32_t D = Entries[Original].FirstDependency,
+                  E = getDependenciesEnd(Original);
+         D != E; ++D) {
+      const uint32_t Dep = SortedFile[Dependencies[D]];
+      SortedDependencies.push_back(Dep);
+      Reverse[NextReverse[Dep]++] = I;
+    }
+  }
+  FirstDependency[NumEntries] = SortedDependencies.size();
+
+  // Dependents were added in entry order, so every list is sorted.
+  const uint32_t BitmapWords = (NumEntries + 31) / 32;
+  std::vector<uint32_t> ReverseWords;
+  std::vector<uint32_t> FirstReverseWord(NumFiles + 1);
+  for (uint32_t I = 0; I != NumFiles; ++I) {
+    FirstReverseWord[I] = ReverseWords.size();
+    const auto Begin = Reverse.begin() + FirstReverse[I];
+    const auto End = std::unique(Begin, Reverse.begin() + FirstReverse[I + 1]);
+    if (uint32_t(End - Begin) <= BitmapWords) {
+      ReverseWords.insert(ReverseWords.end(), Begin, End);
+      continue;
+    }
+    FirstReverseWord[I] |= BitmapFlag;
+    const size_t Bitmap = ReverseWords.size();
+    ReverseWords.resize(Bitmap + BitmapWords);
+    for (auto Entry = Begin; Entry != End; ++Entry)
+      ReverseWords[Bitmap + *Entry / 32] |= 1u << (*Entry % 32);
+  }
+  FirstReverseWord[NumFiles] = ReverseWords.size();
+
+  Words Out;
+  Out.add(DatabaseMagic);
+  Out.add(DatabaseVersion);
+  Out.add64(JSONSize);
+  Out.add64(JSONTime);
+  Out.add(NumFiles);
+  Out.add(NumEntries);
+  Out.add(CommandLines.size());
+  Out.add(Arguments.size());
+  Out.add(Dependencies.size());
+  Out.add(ReverseWords.size());
+  Out.add(Strings.size());
+
+  for (uint32_t I = 0; I != NumFiles; ++I) {
+    Out.add(Files[FileOrder[I]].second);
+    Out.add(FirstEntry[I]);
+    Out.add(FirstReverseWord[I]);
+  }
+  Out.add(0);
+  Out.add(NumEntries);
+  Out.add(FirstReverseWord[NumFiles]);
+
+  for (uint32_t I = 0; I != NumEntries; ++I) {
+    const auto &Entry = Entries[EntryOrder[I]];
+    Out.add(SortedFile[Entry.File]);
+    Out.add(Entry.Directory);
+    Out.add(Entry.CommandLine);
+    Out.add(FirstDependency[I]);
+  }
+  Out.add(0);
+  Out.add(0);
+  Out.add(CommandLines.size());
+  Out.add(Dependencies.size());
+
+  for (auto FirstArgument : CommandLines)
+    Out.add(FirstArgument);
+  Out.add(Arguments.size());
+  for (auto Argument : Arguments)
+    Out.add(Argument);
+  for (auto Dep : SortedDependencies)
+    Out.add(Dep);
+  for (auto ReverseWord : ReverseWords)
+    Out.add(ReverseWord);
+  Out.Data += Strings;
+  return Out.Data;
+}
+
+static const DependencyDatabase *LoadedDatabase = nullptr;
+
+// Returns the size and modification time, in nanoseconds, of FilePath.
+static std::error_code getStamp(StringRef FilePath, uint64_t &Size,
+                                uint64_t &Time) {
+  llvm::sys::fs::file_status Status;
+  if (std::error_code EC = llvm::sys::fs::status(FilePath, Status))
+    return EC;
+  const auto Modified = Status.getLastModificationTime();
+  Size = Status.getSize();
+  Time = Modified.toEpochTime() * 1000000000 + Modified.nanoseconds();
+  return std::error_code();
+}
+
+// Writes Data to Path through a temporary file, so that other processes
+// never map a partial cache. Failing to write the cache is not an error.
+static bool writeCache(StringRef Path, StringRef Data) {
+  int FD;
+  SmallString<128> TempPath;
+  if (llvm::sys::fs::createUniqueFile(Path + "-%%%%%%", FD, TempPath))
+    return false;
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Data;
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      llvm::sys::fs::remove(TempPath.str());
+      return false;
+    }
+  }
+  if (llvm::sys::fs::rename(TempPath.str(), Path)) {
+    llvm::sys::fs::remove(TempPath.str());
+    return false;
+  }
+  return true;
+}
+
+std::string DependencyDatabase::getCachePath(StringRef FilePath) {
+  return (FilePath + ".cache").str();
 }
 
-// Register the DependencyDatabasePlugin with the
-// CompilationDatabasePluginRegistry using this statically initialized variable.
 DependencyDatabase *
 DependencyDatabase::loadFromFile(StringRef FilePath,
                                  std::string &ErrorMessage) {
-  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> DatabaseBuffer =
-      llvm::MemoryBuffer::getFile(FilePath);
-  if (std::error_code Result = DatabaseBuffer.getError()) {
+  uint64_t JSONSize, JSONTime;
+  if (std::error_code Result = getStamp(FilePath, JSONSize, JSONTime)) {
     ErrorMessage = "Error while opening JSON database: " + Result.message();
     return nullptr;
   }
-  std::unique_ptr<DependencyDatabase> Database(
-      new DependencyDatabase(DatabaseBuffer->release()));
-  if (!Database->parse(ErrorMessage))
-    return nullptr;
+
+  std::unique_ptr<DependencyDatabase> Database(new DependencyDatabase);
+  const std::string CachePath = getCachePath(FilePath);
+  auto CacheBuffer = llvm::MemoryBuffer::getFile(
+      CachePath, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
+  std::string CacheError;
+  if (!CacheBuffer || !Database->setBuffer(std::move(*CacheBuffer), JSONSize,
+                                           JSONTime, CacheError)) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> DatabaseBuffer =
+        llvm::MemoryBuffer::getFile(FilePath);
+    if (std::error_code Result = DatabaseBuffer.getError()) {
+      ErrorMessage = "Error while opening JSON database: " + Result.message();
+      return nullptr;
+    }
+    const std::string Data = parse(std::move(*DatabaseBuffer), JSONSize,
+                                   JSONTime, ErrorMessage);
+    if (Data.empty())
+      return nullptr;
+
+    // Use the cache as the next run would, or the database in memory if the
+    // cache cannot be written.
+    std::unique_ptr<llvm::MemoryBuffer> Buffer;
+    if (writeCache(CachePath, Data)) {
+      auto Written = llvm::MemoryBuffer::getFile(
+          CachePath, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
+      if (Written)
+        Buffer = std::move(*Written);
+    }
+    if (!Buffer)
+      Buffer = std::unique_ptr<llvm::MemoryBuffer>(
+          llvm::MemoryBuffer::getMemBufferCopy(Data, CachePath));
+    if (!Database->setBuffer(std::move(Buffer), JSONSize, JSONTime,
+                             ErrorMessage))
+      return nullptr;
+  }
+
+  LoadedDatabase = Database.get();
   return Database.release();
 }
 
-std::vector<CompileCommand>
-DependencyDatabase::getCompileCommands(StringRef FilePath) const {
+const DependencyDatabase *DependencyDatabase::getLoaded() {
+  return LoadedDatabase;
+}
+
+DependencyDatabase::~DependencyDatabase() {
+  if (LoadedDatabase == this)
+    LoadedDatabase = nullptr;
+}
+
+bool DependencyDatabase::setBuffer(std::unique_ptr<llvm::MemoryBuffer> Data,
+                                   uint64_t JSONSize, uint64_t JSONTime,
+                                   std::string &ErrorMessage) {
+  const char *Start = Data->getBufferStart();
+  const uint64_t Size = Data->getBufferSize();
+  const Word *Header = reinterpret_cast<const Word *>(Start);
+  if (Size < HeaderSize * sizeof(Word) || Header[0] != DatabaseMagic ||
+      Header[1] != DatabaseVersion) {
+    ErrorMessage = "Not a dependency database cache.";
+    return false;
+  }
+  if ((uint64_t(Header[3]) << 32 | Header[2]) != JSONSize ||
+      (uint64_t(Header[5]) << 32 | Header[4]) != JSONTime) {
+    ErrorMessage = "Dependency database cache is out of date.";
+    return false;
+  }
+
+  NumFiles = Header[6];
+  NumEntries = Header[7];
+  NumCommandLines = Header[8];
+  NumArguments = Header[9];
+  NumDependencies = Header[10];
+  NumReverseWords = Header[11];
+  const uint64_t StringsSize = Header[12];
+
+  const uint64_t NumWords = HeaderSize +
+                            (uint64_t(NumFiles) + 1) * FileRecordSize +
+                            (uint64_t(NumEntries) + 1) * EntryRecordSize +
+                            (uint64_t(NumCommandLines) + 1) + NumArguments +
+                            uint64_t(NumDependencies) + NumReverseWords;
+  if (NumWords * sizeof(Word) + StringsSize != Size ||
+      (StringsSize && Start[Size - 1] != '\0')) {
+    ErrorMessage = "Truncated dependency database cache.";
+    return false;
+  }
+
+  FileTable = Header + HeaderSize;
+  EntryTable = FileTable + (uint64_t(NumFiles) + 1) * FileRecordSize;
+  CommandLines = EntryTable + (uint64_t(NumEntries) + 1) * EntryRecordSize;
+  Arguments = CommandLines + (uint64_t(NumCommandLines) + 1);
+  Dependencies = Arguments + NumArguments;
+  ReverseDependencies = Dependencies + NumDependencies;
+  Strings = reinterpret_cast<const char *>(ReverseDependencies +
+                                           NumReverseWords);
+  Buffer = std::move(Data);
+  return true;
+}
+
+uint32_t DependencyDatabase::findFile(StringRef FilePath) const {
+  uint32_t Low = 0, High = NumFiles;
+  while (Low < High) {
+    const uint32_t Mid = Low + (High - Low) / 2;
+    const int Cmp = getFilePath(Mid).compare(FilePath);
+    if (Cmp == 0)
+      return Mid;
+    if (Cmp < 0)
+      Low = Mid + 1;
+    else
+      High = Mid;
+  }
+  return NumFiles;
+}
+
+uint32_t DependencyDatabase::findEquivalent(StringRef FilePath) const {
   SmallString<128> NativeFilePath;
   llvm::sys::path::native(FilePath, NativeFilePath);
 
+  const uint32_t File = findFile(NativeFilePath);
+  if (File != NumFiles)
+    return File;
+
+  std::call_once(MatchTrieFlag, [this] {
+    for (uint32_t I = 0; I != NumFiles; ++I)
+      MatchTrie.insert(getFilePath(I));
+  });
   std::string Error;
   llvm::raw_string_ostream ES(Error);
   StringRef Match = MatchTrie.findEquivalent(NativeFilePath.str(), ES);
-  if (Match.empty()) {
-    return std::vector<CompileCommand>();
+  return Match.empty() ? NumFiles : findFile(Match);
+}
+
+void DependencyDatabase::addEntries(uint32_t File,
+                                    llvm::BitVector &Entries) const {
+  const uint32_t FirstEntry = getFile(File)[1];
+  const uint32_t EndEntry = getFile(File + 1)[1];
+  if (FirstEntry != EndEntry) {
+    Entries.set(FirstEntry, EndEntry);
+    return;
   }
 
-  auto CmdsRefIt = IndexByFile.find(Match);
-  if (CmdsRefIt != IndexByFile.end()) {
-    std::vector<CompileCommand> Commands;
-    getCommands(CmdsRefIt->getValue(), Commands);
-    return Commands;
+  const uint32_t Begin = getFile(File)[2];
+  const uint32_t End = getFile(File + 1)[2] & ~BitmapFlag;
+  const Word *Reverse = ReverseDependencies + (Begin & ~BitmapFlag);
+  const uint32_t Size = End - (Begin & ~BitmapFlag);
+  if (!(Begin & BitmapFlag)) {
+    for (uint32_t I = 0; I != Size; ++I)
+      Entries.set(Reverse[I]);
+  } else if (llvm::sys::IsLittleEndianHost) {
+    Entries.setBitsInMask(reinterpret_cast<const uint32_t *>(Reverse), Size);
+  } else {
+    for (uint32_t I = 0; I != Size; ++I)
+      for (uint32_t Bits = Reverse[I]; Bits; Bits &= Bits - 1)
+        Entries.set(I * 32 + llvm::countTrailingZeros(Bits));
   }
+}
 
-  auto RDepsIt = ReverseDeps.find(Match);
-  if (RDepsIt != ReverseDeps.end()) {
-    std::vector<CompileCommand> Commands;
-    auto &RDeps = RDepsIt->getValue();
-    for (auto it = RDeps.begin(), end = RDeps.end(); it != end; ++it) {
-      getCommands(IndexByFile.find(*it)->getValue(), Commands);
-    }
-    return Commands;
+llvm::BitVector
+DependencyDatabase::getEntries(ArrayRef<StringRef> FilePaths) const {
+  llvm::BitVector Entries(NumEntries);
+  for (auto FilePath : FilePaths) {
+    const uint32_t File = findEquivalent(FilePath);
+    if (File != NumFiles)
+      addEntries(File, Entries);
   }
-  return std::vector<CompileCommand>();
+  return Entries;
+}
+
+std::vector<DependencyDatabase::CompileCommandRef>
+DependencyDatabase::getCompileCommandRefs(
+    const llvm::BitVector &Entries) const {
+  std::vector<CompileCommandRef> Commands;
+  for (int I = Entries.find_first(); I != -1; I = Entries.find_next(I))
+    Commands.push_back(getCommand(I));
+  return Commands;
+}
+
+std::vector<DependencyDatabase::CompileCommandRef>
+DependencyDatabase::getCompileCommandRefs(StringRef FilePath) const {
+  return getCompileCommandRefs(getEntries(FilePath));
+}
+
+std::vector<CompileCommand>
+DependencyDatabase::getCompileCommands(StringRef FilePath) const {
+  std::vector<CompileCommand> Commands;
+  for (const auto &Ref : getCompileCommandRefs(FilePath))
+    Commands.push_back(Ref.toCompileCommand());
+  return Commands;
 }
 
 std::vector<std::string>
-DependencyDatabase::getAllFiles() const {
+DependencyDatabase::getSourceFiles(const llvm::BitVector &Entries) const {
+  // Entries are ordered by file.
   std::vector<std::string> Result;
-
-  llvm::StringMap< std::vector<CompileCommandRef> >::const_iterator
-    CommandsRefI = IndexByFile.begin();
-  const llvm::StringMap< std::vector<CompileCommandRef> >::const_iterator
-    CommandsRefEnd = IndexByFile.end();
-  for (; CommandsRefI != CommandsRefEnd; ++CommandsRefI) {
-    Result.push_back(CommandsRefI->first().str());
+  uint32_t Previous = NumFiles;
+  for (int I = Entries.find_first(); I != -1; I = Entries.find_next(I)) {
+    const uint32_t SourceFile = getEntry(I)[0];
+    if (SourceFile != Previous)
+      Result.push_back(getFilePath(SourceFile));
+    Previous = SourceFile;
   }
+  return Result;
+}
 
+std::vector<std::string>
+DependencyDatabase::getSourceFiles(StringRef FilePath) const {
+  return getSourceFiles(getEntries(FilePath));
+}
+
+std::vector<StringRef>
+DependencyDatabase::getDependencies(StringRef SourceFile) const {
+  std::vector<StringRef> Result;
+  const uint32_t File = findFile(SourceFile);
+  if (File == NumFiles)
+    return Result;
+
+  std::vector<uint32_t> Deps;
+  for (uint32_t I = getFile(File)[1], E = getFile(File + 1)[1]; I != E; ++I)
+    Deps.insert(Deps.end(), Dependencies + getEntry(I)[3],
+                Dependencies + getEntry(I + 1)[3]);
+  std::sort(Deps.begin(), Deps.end());
+  Deps.erase(std::unique(Deps.begin(), Deps.end()), Deps.end());
+  for (auto Dep : Deps)
+    Result.push_back(getFilePath(Dep));
+  return Result;
+}
+
+std::vector<std::string>
+DependencyDatabase::getAllFiles() const {
+  std::vector<std::string> Result;
+  for (uint32_t I = 0; I != NumFiles; ++I)
+    if (getFile(I)[1] != getFile(I + 1)[1])
+      Result.push_back(getFilePath(I));
   return Result;
 }
 
 std::vector<CompileCommand>
 DependencyDatabase::getAllCompileCommands() const {
   std::vector<CompileCommand> Commands;
-  for (llvm::StringMap< std::vector<CompileCommandRef> >::const_iterator
-        CommandsRefI = IndexByFile.begin(), CommandsRefEnd = IndexByFile.end();
-      CommandsRefI != CommandsRefEnd; ++CommandsRefI) {
-    getCommands(CommandsRefI->getValue(), Commands);
-  }
+  for (uint32_t I = 0; I != NumEntries; ++I)
+    Commands.push_back(getCommand(I).toCompileCommand());
   return Commands;
 }
 
-void DependencyDatabase::getCommands(
-                                  ArrayRef<CompileCommandRef> CommandsRef,
-                                  std::vector<CompileCommand> &Commands) const {
-  for (int I = 0, E = CommandsRef.size(); I != E; ++I) {
-    SmallString<8> DirectoryStorage;
-    SmallString<1024> CommandStorage;
-    Commands.push_back(CompileCommand(
-      // FIXME: Escape correctly:
-      CommandsRef[I].first->getValue(DirectoryStorage),
-      unescapeCommandLine(CommandsRef[I].second->getValue(CommandStorage))));
-  }
+DependencyDatabase::CompileCommandRef
+DependencyDatabase::getCommand(uint32_t Entry) const {
+  const Word *Record = getEntry(Entry);
+  const uint32_t Begin = CommandLines[Record[2]];
+  const uint32_t End = CommandLines[Record[2] + 1];
+  CompileCommandRef Ref;
+  Ref.File = getFilePath(Record[0]);
+  Ref.Directory = getString(Record[1]);
+  Ref.CommandLine = CommandLineRef(Arguments + Begin, End - Begin, Strings);
+  return Ref;
+}
+
+std::vector<std::string> CommandLineRef::vec() const {
+  std::vector<std::string> Result;
+  Result.reserve(size());
+  for (unsigned I = 0, E = size(); I != E; ++I)
+    Result.push_back((*this)[I]);
+  return Result;
 }
 
-static SmallString<128>
-getNativePath(llvm::yaml::ScalarNode *File, llvm::yaml::ScalarNode *Directory) {
-  SmallString<16> FileStorage;
-  StringRef FileName = File->getValue(FileStorage);
+CompileCommand DependencyDatabase::CompileCommandRef::toCompileCommand() const {
+  return CompileCommand(Directory, CommandLine.vec());
+}
+
+static std::string getNativePath(StringRef FileName, StringRef Directory) {
   SmallString<128> NativeFilePath;
   if (llvm::sys::path::is_relative(FileName)) {
-    SmallString<8> DirectoryStorage;
-    SmallString<128> AbsolutePath(Directory->getValue(DirectoryStorage));
+    SmallString<128> AbsolutePath(Directory);
     llvm::sys::path::append(AbsolutePath, FileName);
     llvm::sys::path::native(AbsolutePath.str(), NativeFilePath);
   } else {
     llvm::sys::path::native(FileName, NativeFilePath);
   }
-  return NativeFilePath;
+  return NativeFilePath.str();
 }
 
-bool DependencyDatabase::parse(std::string &ErrorMessage) {
-  llvm::yaml::document_iterator I = YAMLStream.begin();
-  if (I == YAMLStream.end()) {
-    ErrorMessage = "Error while parsing YAML.";
-    return false;
-  }
-  llvm::yaml::Node *Root = I->getRoot();
-  if (!Root) {
-    ErrorMessage = "Error while parsing YAML.";
-    return false;
-  }
-  llvm::yaml::SequenceNode *Array = dyn_cast<llvm::yaml::SequenceNode>(Root);
-  if (!Array) {
-    ErrorMessage = "Expected array.";
-    return false;
-  }
-  for (llvm::yaml::SequenceNode::iterator AI = Array->begin(),
-                                          AE = Array->end();
-       AI != AE; ++AI) {
-    llvm::yaml::MappingNode *Object = dyn_cast<llvm::yaml::MappingNode>(&*AI);
-    if (!Object) {
-      ErrorMessage = "Expected object.";
-      return false;
-    }
-    llvm::yaml::ScalarNode *Directory = nullptr;
-    llvm::yaml::ScalarNode *Command = nullptr;
-    llvm::yaml::ScalarNode *File = nullptr;
-    llvm::SmallVector<llvm::yaml::ScalarNode *, 8> Deps;
-    for (llvm::yaml::MappingNode::iterator KVI = Object->begin(),
-                                           KVE = Object->end();
-         KVI != KVE; ++KVI) {
-      llvm::yaml::Node *Value = (*KVI).getValue();
-      if (!Value) {
-        ErrorMessage = "Expected value.";
-        return false;
-      }
-      llvm::yaml::ScalarNode *KeyString =
-          dyn_cast<llvm::yaml::ScalarNode>((*KVI).getKey());
-      if (!KeyString) {
-        ErrorMessage = "Expected strings as key.";
-        return false;
-      }
+namespace {
+/// \brief An entry of the JSON database, with its paths made absolute and its
+/// command line split.
+struct ParsedEntry {
+  std::string File;
+  std::string Directory;
+  std::vector<std::string> CommandLine;
+  std::vector<std::string> Deps;
+};
+} // end namespace
+
+/// \brief Reads the object that comes next in Reader into Entry.
+static bool parseEntry(JSONReader &Reader, ParsedEntry &Entry) {
+  if (Reader.peek() != '{')
+    return Reader.fail("Expected object");
+  Reader.expect('{');
 
-      SmallString<8> KeyStorage;
-      llvm::yaml::ScalarNode *ValueString = nullptr;
-
-      if (auto SeqNode = dyn_cast<llvm::yaml::SequenceNode>(Value)) {
-        if (KeyString->getValue(KeyStorage) == "deps") {
-          for (auto DepsIt = SeqNode->begin(), DepsE = SeqNode->end();
-               DepsIt != DepsE;
-               ++DepsIt) {
-            auto *Node = dyn_cast<llvm::yaml::ScalarNode>(&*DepsIt);
-            if (!Node) {
-              ErrorMessage = "Expecting string values in dependency sequence.";
+  bool HasDirectory = false, HasCommand = false, HasFile = false;
+  std::string Key, Command, File;
+  std::vector<std::string> Deps;
+  if (!Reader.consume('}')) {
+    do {
+      if (!Reader.readString(Key) || !Reader.expect(':'))
+        return false;
+      if (Key == "deps") {
+        if (Reader.peek() != '[')
+          return Reader.fail("Expected sequence value for \"deps\"");
+        Reader.expect('[');
+        if (!Reader.consume(']')) {
+          do {
+            if (Reader.peek() != '"')
+              return Reader.fail(
+                  "Expecting string values in dependency sequence");
+            Deps.emplace_back();
+            if (!Reader.readString(Deps.back()))
               return false;
-            }
-            Deps.push_back(Node);
-          }
-        } else {
-          ErrorMessage = ("Unknown key: \"" +
-                          KeyString->getRawValue() + "\"").str();
-          return false;
-        }
-      } else if ((ValueString = dyn_cast<llvm::yaml::ScalarNode>(Value))) {
-        if (KeyString->getValue(KeyStorage) == "directory") {
-          Directory = ValueString;
-        } else if (KeyString->getValue(KeyStorage) == "command") {
-          Command = ValueString;
-        } else if (KeyString->getValue(KeyStorage) == "file") {
-          File = ValueString;
-        } else {
-          ErrorMessage = ("Unknown key: \"" +
-                          KeyString->getRawValue() + "\"").str();
-          return false;
+          } while (Reader.consume(','));
+          if (!Reader.expect(']'))
+            return false;
         }
+        continue;
+      }
+
+      std::string *Value;
+      if (Key == "directory") {
+        Value = &Entry.Directory;
+        HasDirectory = true;
+      } else if (Key == "command") {
+        Value = &Command;
+        HasCommand = true;
+      } else if (Key == "file") {
+        Value = &File;
+        HasFile = true;
       } else {
-        ErrorMessage = "Expected string or sequence value.";
-        return false;
+        return Reader.fail("Unknown key: \"" + Key + "\"");
       }
-    }
-    if (!File) {
-      ErrorMessage = "Missing key: \"file\".";
-      return false;
-    }
-    if (!Command) {
-      ErrorMessage = "Missing key: \"command\".";
-      return false;
-    }
-    if (!Directory) {
-      ErrorMessage = "Missing key: \"directory\".";
+      if (Reader.peek() != '"')
+        return Reader.fail("Expected string value for \"" + Key + "\"");
+      if (!Reader.readString(*Value))
+        return false;
+    } while (Reader.consume(','));
+    if (!Reader.expect('}'))
       return false;
-    }
-    SmallString<128> NativeFilePath = getNativePath(File, Directory);
-    MatchTrie.insert(NativeFilePath.str());
-
-    auto &tuEntry= IndexByFile.GetOrCreateValue(NativeFilePath);
-    tuEntry.getValue().push_back(CompileCommandRef(Directory, Command));
+  }
 
-    for (auto it = Deps.begin(), end = Deps.end(); it != end; ++it) {
-      SmallString<128> DepPath = getNativePath(*it, Directory);;
+  if (!HasFile)
+    return Reader.fail("Missing key: \"file\"");
+  if (!HasCommand)
+    return Reader.fail("Missing key: \"command\"");
+  if (!HasDirectory)
+    return Reader.fail("Missing key: \"directory\"");
+
+  Entry.File = getNativePath(File, Entry.Directory);
+  // FIXME: Escape correctly:
+  Entry.CommandLine = unescapeCommandLine(Command);
+  for (const auto &Dep : Deps)
+    Entry.Deps.push_back(getNativePath(Dep, Entry.Directory));
+  return true;
+}
 
-      auto &DepEntry = ReverseDeps.GetOrCreateValue(DepPath);
-      DepEntry.getValue().push_back(tuEntry.getKey());
+/// \brief Reads the comma-separated objects in Chunk, a slice of JSON, into
+/// Entries.
+static bool parseChunk(StringRef JSON, StringRef Chunk,
+                       std::vector<ParsedEntry> &Entries,
+                       std::string &ErrorMessage) {
+  JSONReader Reader(Chunk, Chunk.data() - JSON.data());
+  if (!Reader.atEnd()) {
+    do {
+      Entries.emplace_back();
+      if (!parseEntry(Reader, Entries.back()))
+        break;
+    } while (Reader.consume(','));
+    if (Reader.getError().empty() && !Reader.atEnd())
+      Reader.fail("Expected ','");
+  }
+  if (Reader.getError().empty())
+    return true;
+  ErrorMessage = "Error while parsing JSON: " + Reader.getError();
+  return false;
+}
 
-      Dependencies[tuEntry.getKey()].push_back(DepEntry.getKey());
+// Parsing is split into chunks of at least this many bytes.
+static const size_t MinChunkSize = 1 << 20;
+
+std::string
+DependencyDatabase::parse(std::unique_ptr<llvm::MemoryBuffer> JSONBuffer,
+                          uint64_t JSONSize, uint64_t JSONTime,
+                          std::string &ErrorMessage) {
+  const StringRef JSON = JSONBuffer->getBuffer();
+  const unsigned NumChunks = std::max<size_t>(
+      1, std::min<size_t>(std::thread::hardware_concurrency(),
+                          JSON.size() / MinChunkSize));
+  std::vector<StringRef> Chunks;
+  if (!splitJSONArray(JSON, NumChunks, Chunks, ErrorMessage))
+    return std::string();
+
+  // Every chunk is read on a thread of its own, splitting command lines and
+  // making paths absolute on the way.
+  std::vector<std::vector<ParsedEntry>> Entries(Chunks.size());
+  std::vector<std::string> Errors(Chunks.size());
+  std::vector<char> Succeeded(Chunks.size());
+  std::vector<std::thread> Threads;
+  for (size_t I = 1; I < Chunks.size(); ++I)
+    Threads.emplace_back([&, I] {
+      Succeeded[I] = parseChunk(JSON, Chunks[I], Entries[I], Errors[I]);
+    });
+  Succeeded[0] = parseChunk(JSON, Chunks[0], Entries[0], Errors[0]);
+  for (auto &Thread : Threads)
+    Thread.join();
+
+  for (size_t I = 0; I != Chunks.size(); ++I) {
+    if (!Succeeded[I]) {
+      ErrorMessage = Errors[I];
+      return std::string();
+    }
+  }
 
-      MatchTrie.insert(DepPath.str());
+  // The entries own everything the database is built from.
+  Chunks.clear();
+  JSONBuffer.reset();
+
+  // Interning is serial, in the order of the JSON file.
+  DatabaseBuilder Builder;
+  for (auto &Chunk : Entries) {
+    for (const auto &Entry : Chunk) {
+      const uint32_t FileID = Builder.addFile(Entry.File);
+      SmallVector<uint32_t, 8> DepIDs;
+      for (const auto &Dep : Entry.Deps)
+        DepIDs.push_back(Builder.addFile(Dep));
+      Builder.addEntry(FileID, Builder.addString(Entry.Directory),
+                       Entry.CommandLine, DepIDs);
     }
+    std::vector<ParsedEntry>().swap(Chunk);
   }
-  return true;
+  return Builder.finish(JSONSize, JSONTime);
 }
@@ -4,21 +4,79 @@
 #include <clang/Basic/LLVM.h>
 #include <clang/Tooling/CompilationDatabase.h>
 #include <clang/Tooling/FileMatchTrie.h>
-#include <llvm/ADT/DenseMap.h>
-#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/BitVector.h>
 #include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Endian.h>
 #include <llvm/Support/MemoryBuffer.h>
-#include <llvm/Support/SourceMgr.h>
-#include <llvm/Support/YAMLParser.h>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
+/// \brief An immutable view of a command line stored in a DependencyDatabase.
+///
+/// Both the arguments and the sequence of them are stored once, so views of
+/// equal command lines from the same database refer to the same words.
+class CommandLineRef {
+public:
+  typedef llvm::support::ulittle32_t Word;
+
+  CommandLineRef() : Arguments(nullptr), NumArguments(0), Strings(nullptr) {}
+  CommandLineRef(const Word *Arguments, unsigned NumArguments,
+                 const char *Strings)
+    : Arguments(Arguments), NumArguments(NumArguments), Strings(Strings) {}
+
+  unsigned size() const { return NumArguments; }
+  bool empty() const { return NumArguments == 0; }
+  llvm::StringRef operator[](unsigned I) const {
+    return llvm::StringRef(Strings + Arguments[I]);
+  }
+
+  /// \brief Identifies the command line within its database.
+  const void *getOpaqueValue() const { return Arguments; }
+
+  /// \brief Copies the arguments out of the database.
+  std::vector<std::string> vec() const;
+
+private:
+  const Word *Arguments;
+  unsigned NumArguments;
+  const char *Strings;
+};
+
+/// \brief A JSON compilation database whose entries also list the files the
+/// translation unit depends on.
+///
+/// The JSON is only parsed when it changed since it was last loaded. The
+/// parsed database is kept in a binary cache next to it, which later runs map
+/// and use in place: paths, arguments and whole command lines are interned,
+/// and dependencies are stored in both directions as compressed sparse rows,
+/// the dependents of widely included headers as bitmaps. The layout is
+/// described in DependencyDatabase.cpp.
+///
+/// Sets of entries, e.g. the dependents of some headers, are handed out as
+/// BitVectors with one bit per entry, to be combined with its operators.
 class DependencyDatabase : public clang::tooling::CompilationDatabase {
 public:
+  /// \brief Loads the database from the JSON file FilePath, or from its cache
+  /// if that is up to date.
   static DependencyDatabase *
   loadFromFile(llvm::StringRef FilePath, std::string &ErrorMessage);
 
+  /// \brief Returns the path of the cache of the JSON file FilePath.
+  static std::string getCachePath(llvm::StringRef FilePath);
+
+  /// \brief Returns the most recently loaded database that is still alive, or
+  /// null if there is none.
+  ///
+  /// Databases are handed out as plain CompilationDatabases and the tool is
+  /// built without RTTI; this is how the dependency information is reached.
+  static const DependencyDatabase *getLoaded();
+
+  ~DependencyDatabase() override;
+
   /// \brief Returns all compile comamnds in which the specified file was
   /// compiled.
   ///
@@ -27,6 +85,37 @@ public:
   std::vector<clang::tooling::CompileCommand>
   getCompileCommands(llvm::StringRef FilePath) const override;
 
+  /// \brief A compile command as it is stored in the database. Valid as long
+  /// as the database is.
+  struct CompileCommandRef {
+    /// \brief The translation unit the command compiles.
+    llvm::StringRef File;
+    llvm::StringRef Directory;
+    CommandLineRef CommandLine;
+
+    /// \brief Returns a key that is equal for commands compiling in the same
+    /// directory with the same command line. Comparing keys compares
+    /// pointers only.
+    std::pair<const char *, const void *> getKey() const {
+      return std::make_pair(Directory.data(), CommandLine.getOpaqueValue());
+    }
+
+    clang::tooling::CompileCommand toCompileCommand() const;
+  };
+
+  /// \brief Like getCompileCommands(), but without copying the commands out
+  /// of the database.
+  std::vector<CompileCommandRef>
+  getCompileCommandRefs(llvm::StringRef FilePath) const;
+
+  /// \brief Returns the commands of Entries, in order.
+  std::vector<CompileCommandRef>
+  getCompileCommandRefs(const llvm::BitVector &Entries) const;
+
+  /// \brief Returns the entries getCompileCommands() returns the commands of
+  /// for any of FilePaths.
+  llvm::BitVector getEntries(llvm::ArrayRef<llvm::StringRef> FilePaths) const;
+
   /// \brief Returns the list of all files available in the compilation database.
   ///
   /// These are the 'file' entries of the JSON objects.
@@ -37,38 +126,94 @@ public:
   std::vector<clang::tooling::CompileCommand>
   getAllCompileCommands() const override;
 
+  /// \brief Returns the translation units getCompileCommands() returns the
+  /// commands of: FilePath itself for a source file, every dependent
+  /// translation unit for a header.
+  std::vector<std::string> getSourceFiles(llvm::StringRef FilePath) const;
+
+  /// \brief Returns the translation units Entries compile, each once.
+  std::vector<std::string>
+  getSourceFiles(const llvm::BitVector &Entries) const;
+
+  /// \brief Returns the files the translation unit SourceFile depends on, or
+  /// an empty list if SourceFile is not a translation unit in the database.
+  std::vector<llvm::StringRef>
+  getDependencies(llvm::StringRef SourceFile) const;
+
 private:
-  /// \brief Constructs a JSON compilation database on a memory buffer.
-  DependencyDatabase(llvm::MemoryBuffer *Database)
-    : Database(Database), YAMLStream(Database->getBuffer(), SM) {}
+  typedef llvm::support::ulittle32_t Word;
+
+  DependencyDatabase()
+    : FileTable(nullptr), EntryTable(nullptr), CommandLines(nullptr),
+      Arguments(nullptr), Dependencies(nullptr), ReverseDependencies(nullptr),
+      Strings(nullptr), NumFiles(0), NumEntries(0), NumCommandLines(0),
+      NumArguments(0), NumDependencies(0), NumReverseWords(0) {}
 
-  /// \brief Parses the database file and creates the index.
+  /// \brief Uses Buffer, which holds the binary database, and checks it was
+  /// built from a JSON file of the given size and modification time.
   ///
-  /// Returns whether parsing succeeded. Sets ErrorMessage if parsing
-  /// failed.
-  bool parse(std::string &ErrorMessage);
+  /// Returns whether the buffer holds a valid database. Sets ErrorMessage if
+  /// it does not.
+  bool setBuffer(std::unique_ptr<llvm::MemoryBuffer> Buffer,
+                 uint64_t JSONSize, uint64_t JSONTime,
+                 std::string &ErrorMessage);
 
-  // Tuple (directory, commandline) where 'commandline' pointing to the
-  // corresponding nodes in the YAML stream.
-  typedef std::pair<llvm::yaml::ScalarNode*,
-                    llvm::yaml::ScalarNode*> CompileCommandRef;
+  /// \brief Parses the JSON database and returns the binary database, or an
+  /// empty string if parsing failed. Sets ErrorMessage if parsing failed.
+  ///
+  /// Large databases are parsed in parallel. JSON is released as soon as it
+  /// has been read, before the binary database is built.
+  static std::string parse(std::unique_ptr<llvm::MemoryBuffer> JSON,
+                           uint64_t JSONSize, uint64_t JSONTime,
+                           std::string &ErrorMessage);
 
-  /// \brief Converts the given array of CompileCommandRefs to CompileCommands.
-  void getCommands(llvm::ArrayRef<CompileCommandRef> CommandsRef,
-                   std::vector<clang::tooling::CompileCommand> &Commands) const;
+  /// \brief Resolves FilePath to the index of the file it is stored as in
+  /// the database, or returns NumFiles.
+  uint32_t findEquivalent(llvm::StringRef FilePath) const;
 
-private:
-  // Maps file paths to the compile command lines for that file.
-  llvm::StringMap< std::vector<CompileCommandRef> > IndexByFile;
-  llvm::StringMap< std::vector<llvm::StringRef> > ReverseDeps;
+  /// \brief Returns the index of the file stored exactly as FilePath, or
+  /// NumFiles.
+  uint32_t findFile(llvm::StringRef FilePath) const;
+
+  const Word *getFile(uint32_t File) const {
+    return FileTable + File * FileRecordSize;
+  }
+  const Word *getEntry(uint32_t Entry) const {
+    return EntryTable + Entry * EntryRecordSize;
+  }
+  llvm::StringRef getString(uint32_t Offset) const {
+    return llvm::StringRef(Strings + Offset);
+  }
+  llvm::StringRef getFilePath(uint32_t File) const {
+    return getString(getFile(File)[0]);
+  }
+
+  /// \brief Returns the compile command of Entry.
+  CompileCommandRef getCommand(uint32_t Entry) const;
+
+  /// \brief Adds the entries compiling File to Entries, or, if there are
+  /// none, the entries whose dependencies include File.
+  void addEntries(uint32_t File, llvm::BitVector &Entries) const;
 
-  llvm::DenseMap< llvm::StringRef, std::vector<llvm::StringRef> > Dependencies;
+  static const unsigned FileRecordSize = 3;
+  static const unsigned EntryRecordSize = 4;
 
-  clang::tooling::FileMatchTrie MatchTrie;
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+  // The tables in Buffer. Files are sorted by path, entries by file; both
+  // tables end with a sentinel record.
+  const Word *FileTable;
+  const Word *EntryTable;
+  const Word *CommandLines;
+  const Word *Arguments;
+  const Word *Dependencies;
+  const Word *ReverseDependencies;
+  const char *Strings;
+  uint32_t NumFiles, NumEntries, NumCommandLines, NumArguments;
+  uint32_t NumDependencies, NumReverseWords;
 
-  std::unique_ptr<llvm::MemoryBuffer> Database;
-  llvm::SourceMgr SM;
-  llvm::yaml::Stream YAMLStream;
+  // Only needed for paths not stored verbatim, so built on first use.
+  mutable std::once_flag MatchTrieFlag;
+  mutable clang::tooling::FileMatchTrie MatchTrie;
 };
 
 #endif
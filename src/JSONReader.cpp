@@ -0,0 +1,176 @@
+//===----------------------------------------------------------------------===//
+//
+// A small JSON reader for compile_filedeps.json. The database is read once
+// and then cached in binary form, so the reader only has to be fast and
+// frugal: it never builds a document, and strings are copied out of the
+// input exactly once.
+//
+//===----------------------------------------------------------------------===//
+
+#include "JSONReader.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+static bool isWhitespace(char C) {
+  return C == ' ' || C == '\t' || C == '\n' || C == '\r';
+}
+
+static void appendUTF8(std::string &Value, unsigned CodePoint) {
+  if (CodePoint < 0x80) {
+    Value.push_back(CodePoint);
+  } else if (CodePoint < 0x800) {
+    Value.push_back(0xC0 | (CodePoint >> 6));
+    Value.push_back(0x80 | (CodePoint & 0x3F));
+  } else if (CodePoint < 0x10000) {
+    Value.push_back(0xE0 | (CodePoint >> 12));
+    Value.push_back(0x80 | ((CodePoint >> 6) & 0x3F));
+    Value.push_back(0x80 | (CodePoint & 0x3F));
+  } else {
+    Value.push_back(0xF0 | (CodePoint >> 18));
+    Value.push_back(0x80 | ((CodePoint >> 12) & 0x3F));
+    Value.push_back(0x80 | ((CodePoint >> 6) & 0x3F));
+    Value.push_back(0x80 | (CodePoint & 0x3F));
+  }
+}
+
+char JSONReader::peek() {
+  while (Position != Input.size() && isWhitespace(Input[Position]))
+    ++Position;
+  return Position == Input.size() ? 0 : Input[Position];
+}
+
+bool JSONReader::consume(char C) {
+  if (peek() != C)
+    return false;
+  ++Position;
+  return true;
+}
+
+bool JSONReader::expect(char C) {
+  if (consume(C))
+    return true;
+  if (Position == Input.size())
+    return fail(Twine("Expected '") + Twine(C) + "' before end of input");
+  return fail(Twine("Expected '") + Twine(C) + "'");
+}
+
+bool JSONReader::readString(std::string &Value) {
+  if (!expect('"'))
+    return false;
+  Value.clear();
+  const size_t Size = Input.size();
+  for (;;) {
+    size_t End = Position;
+    while (End != Size && Input[End] != '"' && Input[End] != '\\')
+      ++End;
+    if (End == Size)
+      return fail("Unterminated string");
+    Value.append(Input.data() + Position, End - Position);
+    Position = End + 1;
+    if (Input[End] == '"')
+      return true;
+
+    if (Position == Size)
+      return fail("Unterminated string");
+    const char Escaped = Input[Position++];
+    switch (Escaped) {
+    case '"':
+    case '\\':
+    case '/':
+      Value.push_back(Escaped);
+      break;
+    case 'b': Value.push_back('\b'); break;
+    case 'f': Value.push_back('\f'); break;
+    case 'n': Value.push_back('\n'); break;
+    case 'r': Value.push_back('\r'); break;
+    case 't': Value.push_back('\t'); break;
+    case 'u': {
+      auto readHex = [this](unsigned &CodePoint) {
+        if (Input.substr(Position, 4).size() != 4 ||
+            Input.substr(Position, 4).getAsInteger(16, CodePoint))
+          return fail("Invalid \\u escape");
+        Position += 4;
+        return true;
+      };
+      unsigned CodePoint;
+      if (!readHex(CodePoint))
+        return false;
+      // Characters outside the basic plane come as a surrogate pair.
+      if (CodePoint >= 0xD800 && CodePoint < 0xDC00 &&
+          Input.substr(Position).startswith("\\u")) {
+        Position += 2;
+        unsigned Low;
+        if (!readHex(Low))
+          return false;
+        if (Low < 0xDC00 || Low >= 0xE000)
+          return fail("Invalid surrogate pair");
+        CodePoint = 0x10000 + ((CodePoint - 0xD800) << 10) + (Low - 0xDC00);
+      }
+      appendUTF8(Value, CodePoint);
+      break;
+    }
+    default:
+      return fail("Invalid escape sequence");
+    }
+  }
+}
+
+bool JSONReader::fail(const Twine &Message) {
+  if (Error.empty())
+    Error =
+        (Message + " at offset " + Twine(BaseOffset + Position) + ".").str();
+  return false;
+}
+
+bool splitJSONArray(StringRef JSON, unsigned NumChunks,
+                    std::vector<StringRef> &Chunks,
+                    std::string &ErrorMessage) {
+  size_t Begin = 0;
+  while (Begin != JSON.size() && isWhitespace(JSON[Begin]))
+    ++Begin;
+  if (Begin == JSON.size() || JSON[Begin] != '[') {
+    ErrorMessage = "Expected array.";
+    return false;
+  }
+  ++Begin;
+
+  const size_t ChunkSize = (JSON.size() - Begin) / std::max(NumChunks, 1u);
+  size_t ChunkBegin = Begin;
+  unsigned Depth = 1;
+  for (size_t I = Begin, E = JSON.size(); I < E; ++I) {
+    switch (JSON[I]) {
+    case '"':
+      while (++I < E && JSON[I] != '"')
+        if (JSON[I] == '\\')
+          ++I;
+      break;
+    case '[':
+    case '{':
+      ++Depth;
+      break;
+    case ']':
+    case '}':
+      if (--Depth != 0)
+        break;
+      Chunks.push_back(JSON.slice(ChunkBegin, I));
+      for (++I; I != E; ++I) {
+        if (!isWhitespace(JSON[I])) {
+          ErrorMessage = "Expected end of input at offset " +
+                         std::to_string(I) + ".";
+          return false;
+        }
+      }
+      return true;
+    case ',':
+      if (Depth == 1 && I - ChunkBegin >= ChunkSize) {
+        Chunks.push_back(JSON.slice(ChunkBegin, I));
+        ChunkBegin = I + 1;
+      }
+      break;
+    }
+  }
+  ErrorMessage = "Unterminated array.";
+  return false;
+}
@@ -0,0 +1,60 @@
+#ifndef CLANG_RENAME_JSONREADER_H
+#define CLANG_RENAME_JSONREADER_H
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/Twine.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/// \brief A forward-only reader of JSON text.
+///
+/// Values are read straight out of the input into storage the caller owns;
+/// no document is built. The reader may be given a slice of a larger input,
+/// in which case errors report offsets into the whole input.
+class JSONReader {
+public:
+  explicit JSONReader(llvm::StringRef Input, size_t BaseOffset = 0)
+    : Input(Input), Position(0), BaseOffset(BaseOffset) {}
+
+  /// \brief Returns the next character that is not whitespace, or 0 at the
+  /// end of the input.
+  char peek();
+
+  /// \brief Returns whether only whitespace is left.
+  bool atEnd() { return peek() == 0; }
+
+  /// \brief Consumes C if it is the next character that is not whitespace.
+  bool consume(char C);
+
+  /// \brief Consumes C, or fails if something else comes next.
+  bool expect(char C);
+
+  /// \brief Reads a string and stores it unescaped in Value.
+  bool readString(std::string &Value);
+
+  /// \brief Records Message as the error at the current position and
+  /// returns false.
+  bool fail(const llvm::Twine &Message);
+
+  /// \brief Returns the message of the first failure, including its offset.
+  const std::string &getError() const { return Error; }
+
+private:
+  llvm::StringRef Input;
+  size_t Position;
+  size_t BaseOffset;
+  std::string Error;
+};
+
+/// \brief Splits the elements of the array JSON consists of into at most
+/// NumChunks slices of about equal size, cut between elements.
+///
+/// Every slice holds a comma-separated list of elements. Only brackets and
+/// strings are looked at; the slices still have to be read to find other
+/// errors. Returns false and sets ErrorMessage if JSON is not an array.
+bool splitJSONArray(llvm::StringRef JSON, unsigned NumChunks,
+                    std::vector<llvm::StringRef> &Chunks,
+                    std::string &ErrorMessage);
+
+#endif
@@ -1,5 +1,106 @@
+" Renames the symbol under the cursor to a:name.
+"
+" If g:clang_rename_socket names the socket of a running clang-rename server,
+" e.g. started with
+"     clang-rename server -p <build-path> -socket=<socket>
+" the rename is sent to it without blocking the editor, and the edited buffers
+" are reloaded when it answers. Buffers modified in the meantime are not
+" reloaded but reported, as writing them would undo the rename. Otherwise
+" clang-rename is run for each rename.
 function! ClangRename(name)
     let offset = line2byte(line(".")) + col(".") - 2
-    call system("clang-rename -i -offset=" . offset . " -new-name=" . a:name . " " . expand("%:p"))
+    let file = expand("%:p")
+    if exists("g:clang_rename_socket")
+        let request = "rename " . offset . " " . a:name . " " . file . "\n"
+        if s:SendRequest(g:clang_rename_socket, request)
+            return
+        endif
+    endif
+    call system("clang-rename -i -offset=" . offset . " -new-name=" . a:name . " " . file)
     edit
 endfunction
+
+" Handles one line of the server's answer.
+function! s:OnLine(line)
+    if a:line =~# '^file '
+        let bufnr = bufnr(fnameescape(a:line[5:]))
+        if bufnr != -1 && getbufvar(bufnr, "&modified")
+            call add(s:modified, bufname(bufnr))
+        elseif bufnr != -1
+            call add(s:edited, bufnr)
+        endif
+    elseif a:line =~# '^ok'
+        call s:Reload()
+    elseif a:line =~# '^error '
+        call s:Reload()
+        echoerr "clang-rename: " . a:line[6:]
+    endif
+endfunction
+
+" Reloads the buffers the last rename edited.
+function! s:Reload()
+    let current = bufnr("%")
+    for bufnr in s:edited
+        if bufnr == current
+            silent edit
+        else
+            execute "checktime " . bufnr
+        endif
+    endfor
+    let s:edited = []
+    if !empty(s:modified)
+        echoerr "clang-rename: not reloaded, as they were modified since; "
+                    \ . "reload them with :edit! or the rename is lost: "
+                    \ . join(s:modified, ", ")
+    endif
+    let s:modified = []
+endfunction
+
+" Sends request to the server listening on socket. Returns 0 if there is no
+" server to send it to.
+function! s:SendRequest(socket, request)
+    let s:edited = []
+    let s:modified = []
+    if has("nvim")
+        let s:partial = ""
+        try
+            let channel = sockconnect("pipe", a:socket,
+                        \ {"on_data": function("s:OnNvimData")})
+        catch
+            return 0
+        endtry
+        call chansend(channel, a:request)
+        return 1
+    endif
+
+    if !has("channel")
+        return 0
+    endif
+    let channel = ch_open("unix:" . a:socket,
+                \ {"mode": "nl", "callback": function("s:OnVimMessage")})
+    if ch_status(channel) != "open"
+        return 0
+    endif
+    call ch_sendraw(channel, a:request)
+    return 1
+endfunction
+
+function! s:OnVimMessage(channel, line)
+    call s:OnLine(a:line)
+    if a:line =~# '^\(ok\|error\)'
+        call ch_close(a:channel)
+    endif
+endfunction
+
+" Neovim hands over data in chunks that need not end at line breaks.
+function! s:OnNvimData(channel, data, event)
+    let lines = copy(a:data)
+    let lines[0] = s:partial . lines[0]
+    let s:partial = remove(lines, -1)
+    for line in lines
+        call s:OnLine(line)
+        if line =~# '^\(ok\|error\)'
+            call chanclose(a:channel)
+        endif
+    endfor
+endfunction
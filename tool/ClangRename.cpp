@@ -13,8 +13,11 @@
 ///
 //===----------------------------------------------------------------------===//
 
-#include "../USRFindingAction.h"
-#include "../RenamingAction.h"
+#include "Commands.h"
+#include "../RenameDriver.h"
+#include "../RenameStatistics.h"
+#include "../SymbolIndex.h"
+#include "../TranslationUnitTimes.h"
 #include "../src/DependencyDatabasePlugin.h"
 
 #include "clang/AST/ASTConsumer.h"
@@ -36,11 +39,16 @@
 #include "clang/Tooling/Refactoring.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Host.h"
+#include "llvm/Support/raw_ostream.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <ctype.h>
+#include <algorithm>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -73,6 +81,93 @@ PrintLocations(
     "pl",
     cl::desc("Print the locations affected by renaming to stderr."),
     cl::cat(ClangRenameCategory));
+cl::opt<unsigned>
+Jobs(
+    "j",
+    cl::desc("Number of translation units to rename in parallel "
+             "(0 = one per hardware thread)."),
+    cl::init(1),
+    cl::cat(ClangRenameCategory));
+cl::opt<unsigned>
+MaxMemory(
+    "max-memory",
+    cl::desc("Only parse translation units in parallel while their ASTs are "
+             "expected to fit in <MB>, by the sizes recorded in -tu-times "
+             "(0 = no limit)."),
+    cl::value_desc("MB"),
+    cl::cat(ClangRenameCategory));
+cl::opt<bool>
+Isolate(
+    "isolate",
+    cl::desc("Parse in worker processes, so that a translation unit clang "
+             "crashes or hangs on does not take the rename down."),
+    cl::cat(ClangRenameCategory));
+cl::opt<unsigned>
+Timeout(
+    "timeout",
+    cl::desc("With -isolate, kill a worker that spends more than <seconds> "
+             "on a translation unit (0 = no limit)."),
+    cl::value_desc("seconds"),
+    cl::cat(ClangRenameCategory));
+cl::opt<unsigned>
+Retries(
+    "retries",
+    cl::desc("With -isolate, how often to try a translation unit again "
+             "after its worker crashed or timed out."),
+    cl::init(1),
+    cl::cat(ClangRenameCategory));
+static cl::opt<bool>
+LexicalFilter(
+    "lexical-filter",
+    cl::desc("Skip translation units whose files do not spell the symbol's "
+             "name, according to the dependency database."),
+    cl::init(true),
+    cl::cat(ClangRenameCategory));
+cl::list<std::string>
+ExcludedPaths(
+    "exclude",
+    cl::desc("Do not rename in <path>, a file or a directory; system headers "
+             "are never renamed in. May be given more than once."),
+    cl::value_desc("path"),
+    cl::cat(ClangRenameCategory));
+cl::opt<bool>
+DedupHeaders(
+    "dedup-headers",
+    cl::desc("Search a header only in the first translation unit that "
+             "parses it with the same macros and options. Assumes headers "
+             "are self-contained: occurrences in a header that depends on "
+             "what was included before it may be missed."),
+    cl::init(false),
+    cl::cat(ClangRenameCategory));
+static cl::opt<bool>
+Dependents(
+    "dependents",
+    cl::desc("Rename in every translation unit that can see a declaration of "
+             "the symbol, according to the dependency database, instead of "
+             "in those of the given files."),
+    cl::cat(ClangRenameCategory));
+cl::opt<std::string>
+TimesPath(
+    "tu-times",
+    cl::desc("Keep the time every translation unit takes in <file>, to start "
+             "the slowest first next time (default: "
+             "~/.cache/clang-rename/tu-times, none to disable)."),
+    cl::value_desc("file"),
+    cl::cat(ClangRenameCategory));
+static cl::opt<std::string>
+TimeTrace(
+    "time-trace",
+    cl::desc("Write the time every phase of the rename took to <file>, as "
+             "Chrome trace events."),
+    cl::value_desc("file"),
+    cl::cat(ClangRenameCategory));
+cl::opt<std::string>
+IndexPath(
+    "index",
+    cl::desc("Rename from the symbol index in <file> instead of parsing, see "
+             "clang-rename index."),
+    cl::value_desc("file"),
+    cl::cat(ClangRenameCategory));
 
 #define CLANG_RENAME_VERSION "0.0.1"
 
@@ -82,16 +177,40 @@ static void PrintVersion() {
 
 using namespace clang;
 
+std::string getTimesPath() {
+  if (TimesPath == "none")
+    return std::string();
+  if (TimesPath.empty())
+    return rename::TranslationUnitTimes::getDefaultPath();
+  return TimesPath;
+}
+
 const char RenameUsage[] = "A tool to rename symbols in C/C++ code.\n\
 clang-rename renames every occurrence of a symbol found at <offset> in\n\
 <source0>. If -i is specified, the edited files are overwritten to disk.\n\
-Otherwise, the results are written to stdout.\n";
+Otherwise, the results are written to stdout.\n\
+See clang-rename gen-deps -help, clang-rename index -help and\n\
+clang-rename server -help for the other commands.\n";
 
 int main(int argc, const char **argv) {
   clang::rename::registerDependencyDatabasePlugin();
 
   cl::SetVersionPrinter(PrintVersion);
-  tooling::CommonOptionsParser OP(argc, argv, ClangRenameCategory, RenameUsage);
+
+  if (argc > 1 && StringRef(argv[1]) == "gen-deps")
+    return genDepsMain(argc - 1, argv + 1);
+  if (argc > 1 && StringRef(argv[1]) == "index")
+    return indexMain(argc - 1, argv + 1);
+  if (argc > 1 && StringRef(argv[1]) == "server")
+    return serverMain(argc - 1, argv + 1);
+
+  // Parsing the options loads the compilation database.
+  std::unique_ptr<tooling::CommonOptionsParser> OP;
+  {
+    rename::PhaseTimer Timer("load compilation database");
+    OP.reset(new tooling::CommonOptionsParser(argc, argv, ClangRenameCategory,
+                                              RenameUsage));
+  }
 
   // Check the arguments for correctness.
 
@@ -101,54 +220,56 @@ int main(int argc, const char **argv) {
     exit(1);
   }
 
-  // Get the USRs.
-  auto Files = OP.getSourcePathList();
-  tooling::RefactoringTool Tool(OP.getCompilations(), Files);
-  rename::USRFindingAction USRAction(Files[0], SymbolOffset);
+  rename::RenameOptions Options;
+  Options.NewName = NewName;
+  Options.Offset = SymbolOffset;
+  Options.Jobs = Jobs;
+  Options.LexicalFilter = LexicalFilter;
+  Options.Dependents = Dependents;
+  Options.ExcludedPaths = ExcludedPaths;
+  Options.DedupHeaders = DedupHeaders;
+  Options.PrintName = PrintName;
+  Options.PrintLocations = PrintLocations;
+  Options.TimesPath = getTimesPath();
+  Options.MaxMemory = uint64_t(MaxMemory) << 20;
+  Options.Isolate = Isolate;
+  Options.Timeout = Timeout;
+  Options.Retries = Retries;
 
-  // Find the USRs.
-  Tool.run(tooling::newFrontendActionFactory(&USRAction).get());
-  const auto &USRs = USRAction.getUSRs();
-  const auto &PrevName = USRAction.getUSRSpelling();
+  std::unique_ptr<rename::SymbolIndex> Index;
+  if (!IndexPath.empty()) {
+    std::string ErrorMessage;
+    Index = rename::SymbolIndex::load(IndexPath, ErrorMessage);
+    if (!Index) {
+      errs() << "clang-rename: " << ErrorMessage << "\n";
+      exit(1);
+    }
+    Options.Index = Index.get();
+  }
 
+  auto Files = OP->getSourcePathList();
+  tooling::Replacements Replaces;
+  std::string PrevName;
+  int res = rename::collectReplacements(OP->getCompilations(), Files, Options,
+                                        Replaces, PrevName);
   if (PrevName.empty())
     // An error should have already been printed.
     exit(1);
 
-  if (PrintName)
-    errs() << "clang-rename: found name: " << PrevName;
-
-  // Perform the renaming.
-  rename::RenamingAction RenameAction(NewName, PrevName, USRs,
-                                      Tool.getReplacements(), PrintLocations);
-  auto Factory = tooling::newFrontendActionFactory(&RenameAction);
-  int res;
-
-  if (Inplace) {
-    res = Tool.runAndSave(Factory.get());
-  } else {
-    res = Tool.run(Factory.get());
-
-    // Write every file to stdout. Right now we just barf the files without any
-    // indication of which files start where, other than that we print the files
-    // in the same order we see them.
-    LangOptions DefaultLangOptions;
-    IntrusiveRefCntPtr<DiagnosticOptions> DiagOpts =
-        new DiagnosticOptions();
-    TextDiagnosticPrinter DiagnosticPrinter(errs(), &*DiagOpts);
-    DiagnosticsEngine Diagnostics(
-        IntrusiveRefCntPtr<DiagnosticIDs>(new DiagnosticIDs()),
-        &*DiagOpts, &DiagnosticPrinter, false);
-    auto &FileMgr = Tool.getFiles();
-    SourceManager Sources(Diagnostics, FileMgr);
-    Rewriter Rewrite(Sources, DefaultLangOptions);
-
-    Tool.applyAllReplacements(Rewrite);
-    for (const auto &File : Files) {
-      const auto *Entry = FileMgr.getFile(File);
-      auto ID = Sources.translateFile(Entry);
-      Rewrite.getEditBuffer(ID).write(outs());
-    }
+  if (rename::applyReplacements(Replaces, Inplace, Files, outs()))
+    res = 1;
+
+  // -stats is registered by LLVM itself; our counters are reported alongside.
+  if (AreStatisticsEnabled())
+    rename::printStatistics(errs());
+  if (!TimeTrace.empty()) {
+    std::error_code EC;
+    raw_fd_ostream OS(TimeTrace.c_str(), EC, sys::fs::F_Text);
+    if (EC)
+      errs() << "clang-rename: cannot write " << TimeTrace << ": "
+             << EC.message() << "\n";
+    else
+      rename::writeTimeTrace(OS);
   }
 
   exit(res);
@@ -0,0 +1,50 @@
+//===--- tools/extra/clang-rename/Commands.h - Clang rename tool ----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Entry points of the clang-rename commands besides renaming, and the
+/// options they share with it.
+///
+/// Commands are picked by the first argument and parse the rest of the
+/// command line themselves. Their options are function-local statics, as
+/// those of CommonOptionsParser are, so that only one set is registered.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_COMMANDS_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_COMMANDS_H
+
+#include "llvm/Support/CommandLine.h"
+#include <string>
+
+extern llvm::cl::OptionCategory ClangRenameCategory;
+extern llvm::cl::opt<unsigned> Jobs;
+extern llvm::cl::opt<unsigned> MaxMemory;
+extern llvm::cl::opt<bool> Isolate;
+extern llvm::cl::opt<unsigned> Timeout;
+extern llvm::cl::opt<unsigned> Retries;
+extern llvm::cl::list<std::string> ExcludedPaths;
+extern llvm::cl::opt<bool> DedupHeaders;
+extern llvm::cl::opt<std::string> IndexPath;
+extern llvm::cl::opt<std::string> TimesPath;
+
+// Returns the file -tu-times names, its default, or an empty string for none.
+std::string getTimesPath();
+
+// clang-rename gen-deps: writes compile_filedeps.json from
+// compile_commands.json.
+int genDepsMain(int argc, const char **argv);
+
+// clang-rename index: writes the symbol index of a compilation database.
+int indexMain(int argc, const char **argv);
+
+// clang-rename server: serves renames on a Unix domain socket.
+int serverMain(int argc, const char **argv);
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_RENAME_COMMANDS_H
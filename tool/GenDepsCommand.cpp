@@ -0,0 +1,275 @@
+//===--- tools/extra/clang-rename/GenDepsCommand.cpp - Clang rename tool --===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Implements clang-rename gen-deps, which writes compile_filedeps.json
+/// from compile_commands.json.
+///
+/// With -from-build, the dependencies the last build recorded are used where
+/// they are newer than the files they list, see src/BuildDependencies.h.
+/// Every other translation unit is only preprocessed, on the same worker
+/// threads renaming parses on. The files a translation unit includes are
+/// read off its SourceManager afterwards; like -MM, only user headers are
+/// listed, and the source file itself is not. Paths have their symlinks
+/// resolved, as realpath(1) does, with one cache per worker.
+///
+//===----------------------------------------------------------------------===//
+
+#include "Commands.h"
+#include "../JSONWriter.h"
+#include "../ParallelRunner.h"
+#include "../src/BuildDependencies.h"
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Tooling/JSONCompilationDatabase.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <limits.h>
+#include <memory>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace clang;
+
+const char GenDepsUsage[] = "Writes the database clang-rename renames with.\n\
+clang-rename gen-deps preprocesses every translation unit in\n\
+<build-path>/compile_commands.json and writes its commands along with\n\
+the headers each includes to <build-path>/compile_filedeps.json.\n\
+With -from-build, the headers recorded by the last build are used\n\
+instead, and only translation units not built since they last changed\n\
+are preprocessed.\n";
+
+namespace {
+// Resolves symlinks in absolute paths, remembering the paths it resolved.
+class RealPathCache {
+public:
+  StringRef get(StringRef Path);
+
+private:
+  StringMap<std::string> RealPaths;
+};
+
+// Lists the user headers of the translation units one worker preprocesses.
+class DependencyLister : public tooling::FrontendActionFactory {
+public:
+  FrontendAction *create() override {
+    Dependencies.clear();
+    return new ListingAction(*this);
+  }
+
+  // The headers of the translation unit last preprocessed, in the order they
+  // were first included.
+  std::vector<std::string> Dependencies;
+
+private:
+  class ListingAction : public PreprocessOnlyAction {
+  public:
+    explicit ListingAction(DependencyLister &Lister) : Lister(Lister) {}
+
+  protected:
+    void EndSourceFileAction() override {
+      Lister.collect(getCompilerInstance().getSourceManager());
+    }
+
+  private:
+    DependencyLister &Lister;
+  };
+
+  void collect(const SourceManager &SourceMgr);
+
+  RealPathCache RealPaths;
+};
+} // namespace
+
+void DependencyLister::collect(const SourceManager &SourceMgr) {
+  SmallPtrSet<const FileEntry *, 32> Seen;
+  if (const auto *MainFile =
+          SourceMgr.getFileEntryForID(SourceMgr.getMainFileID()))
+    Seen.insert(MainFile);
+  for (unsigned I = 0, E = SourceMgr.local_sloc_entry_size(); I != E; ++I) {
+    const auto &Entry = SourceMgr.getLocalSLocEntry(I);
+    if (!Entry.isFile() ||
+        Entry.getFile().getFileCharacteristic() != SrcMgr::C_User)
+      continue;
+    const auto *File = Entry.getFile().getContentCache()->OrigEntry;
+    if (!File || !Seen.insert(File))
+      continue;
+
+    SmallString<256> Path(File->getName());
+    SourceMgr.getFileManager().FixupRelativePath(Path);
+    sys::fs::make_absolute(Path);
+    Dependencies.push_back(RealPaths.get(Path));
+  }
+}
+
+StringRef RealPathCache::get(StringRef Path) {
+  auto &Entry = RealPaths.GetOrCreateValue(Path);
+  auto &RealPath = Entry.getValue();
+  if (RealPath.empty()) {
+    char Buffer[PATH_MAX];
+    if (::realpath(Entry.getKey().data(), Buffer))
+      RealPath = Buffer;
+    else
+      RealPath = Path;
+  }
+  return RealPath;
+}
+
+// Joins CommandLine into a string the compilation databases split back into
+// the same arguments.
+static std::string joinCommandLine(ArrayRef<std::string> CommandLine) {
+  std::string Result;
+  for (const auto &Argument : CommandLine) {
+    if (!Result.empty())
+      Result += ' ';
+    if (!Argument.empty() &&
+        Argument.find_first_of(" \t\n\"'\\") == std::string::npos) {
+      Result += Argument;
+      continue;
+    }
+    Result += '"';
+    for (char C : Argument) {
+      if (C == '"' || C == '\\')
+        Result += '\\';
+      Result += C;
+    }
+    Result += '"';
+  }
+  return Result;
+}
+
+int genDepsMain(int argc, const char **argv) {
+  static cl::opt<std::string> BuildPath(
+      "p", cl::desc("Build path"), cl::value_desc("build-path"), cl::Required,
+      cl::cat(ClangRenameCategory));
+  static cl::opt<std::string> OutputPath(
+      "o", cl::desc("Write the database to <file> instead."),
+      cl::value_desc("file"), cl::cat(ClangRenameCategory));
+  static cl::opt<bool> FromBuild(
+      "from-build",
+      cl::desc("Read the dependencies from <build-path>/.ninja_deps or the "
+               "compiler's .d files where the build recorded them."),
+      cl::cat(ClangRenameCategory));
+
+  cl::ParseCommandLineOptions(argc, argv, GenDepsUsage);
+
+  std::string ErrorMessage;
+  std::unique_ptr<tooling::CompilationDatabase> Compilations(
+      tooling::JSONCompilationDatabase::loadFromDirectory(BuildPath,
+                                                          ErrorMessage));
+  if (!Compilations) {
+    errs() << "clang-rename: " << ErrorMessage << "\n";
+    return 1;
+  }
+
+  const auto TUs =
+      rename::getTranslationUnits(*Compilations, Compilations->getAllFiles());
+  std::vector<std::vector<std::string>> Dependencies(TUs.size());
+
+  // The translation units left to preprocess, and where they are in TUs.
+  std::vector<rename::TranslationUnit> Outdated;
+  std::vector<size_t> OutdatedIndices;
+  if (FromBuild) {
+    const BuildDependencies Build(BuildPath, ErrorMessage);
+    if (!ErrorMessage.empty())
+      errs() << "clang-rename: " << ErrorMessage << "\n";
+    RealPathCache RealPaths;
+    for (size_t I = 0, E = TUs.size(); I != E; ++I) {
+      if (Build.getDependencies(TUs[I].Command, TUs[I].MainFile,
+                                Dependencies[I])) {
+        for (auto &Dependency : Dependencies[I])
+          Dependency = RealPaths.get(Dependency);
+        continue;
+      }
+      Outdated.push_back(TUs[I]);
+      OutdatedIndices.push_back(I);
+    }
+  } else {
+    Outdated = TUs;
+    for (size_t I = 0, E = TUs.size(); I != E; ++I)
+      OutdatedIndices.push_back(I);
+  }
+  const unsigned NumWorkers = rename::getNumWorkers(Jobs, Outdated.size());
+
+  std::vector<std::unique_ptr<DependencyLister>> Listers;
+  std::vector<tooling::ToolAction *> WorkerActions;
+  for (unsigned I = 0; I != NumWorkers; ++I) {
+    Listers.emplace_back(new DependencyLister);
+    WorkerActions.push_back(Listers.back().get());
+  }
+
+  // Translation units that fail to preprocess keep the headers that were
+  // found, as the compiler's -MM output would.
+  int Result = 0;
+  if (!Outdated.empty())
+    Result = rename::runOnTranslationUnits(
+        Outdated, WorkerActions, [&](size_t Index, unsigned Worker, bool) {
+          Dependencies[OutdatedIndices[Index]] =
+              std::move(Listers[Worker]->Dependencies);
+        });
+
+  SmallString<128> Path(OutputPath);
+  if (Path.empty()) {
+    Path = BuildPath;
+    sys::path::append(Path, "compile_filedeps.json");
+  }
+  // Write through a temporary file, so that renames and the server never
+  // read a partial database, and a failed write keeps the old one.
+  int FD;
+  SmallString<128> TempPath;
+  if (std::error_code EC =
+          sys::fs::createUniqueFile(Path + "-%%%%%%", FD, TempPath)) {
+    errs() << "clang-rename: cannot write " << Path << ": " << EC.message()
+           << "\n";
+    return 1;
+  }
+  raw_fd_ostream OS(FD, /*shouldClose=*/true);
+
+  OS << "[";
+  for (size_t I = 0, E = TUs.size(); I != E; ++I) {
+    const auto &TU = TUs[I];
+    OS << (I ? ",\n" : "\n") << "  {\n    \"directory\": ";
+    writeJSONString(OS, TU.Command.Directory);
+    OS << ",\n    \"command\": ";
+    writeJSONString(OS, joinCommandLine(TU.Command.CommandLine));
+    OS << ",\n    \"file\": ";
+    writeJSONString(OS, TU.MainFile);
+    OS << ",\n    \"deps\": [";
+    for (size_t J = 0, F = Dependencies[I].size(); J != F; ++J) {
+      OS << (J ? ", " : "");
+      writeJSONString(OS, Dependencies[I][J]);
+    }
+    OS << "]\n  }";
+  }
+  OS << "\n]\n";
+  OS.close();
+  if (OS.has_error()) {
+    OS.clear_error();
+    sys::fs::remove(TempPath.str());
+    errs() << "clang-rename: cannot write " << Path << "\n";
+    return 1;
+  }
+  if (std::error_code EC = sys::fs::rename(TempPath.str(), Path.str())) {
+    sys::fs::remove(TempPath.str());
+    errs() << "clang-rename: cannot write " << Path << ": " << EC.message()
+           << "\n";
+    return 1;
+  }
+  return Result;
+}
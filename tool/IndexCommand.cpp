@@ -0,0 +1,107 @@
+//===--- tools/extra/clang-rename/IndexCommand.cpp - Clang rename tool ----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Implements clang-rename index, which records the occurrences of
+/// every USR in a compilation database so that renames need not parse.
+///
+//===----------------------------------------------------------------------===//
+
+#include "Commands.h"
+#include "../ParallelRunner.h"
+#include "../SymbolIndex.h"
+
+#include "clang/AST/ASTConsumer.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace clang;
+
+const char IndexUsage[] = "Builds a symbol index for clang-rename -index.\n\
+clang-rename index parses every translation unit of the compilation\n\
+database in <build-path> and writes the locations of all symbols to\n\
+<file>. If <file> already holds an index, only the translation units\n\
+affected by changes since are parsed again.\n";
+
+int indexMain(int argc, const char **argv) {
+  static cl::opt<std::string> BuildPath(
+      "p", cl::desc("Build path"), cl::value_desc("build-path"), cl::Required,
+      cl::cat(ClangRenameCategory));
+  static cl::opt<std::string> OutputPath(
+      "o", cl::desc("Write the index to <file>."), cl::value_desc("file"),
+      cl::Required, cl::cat(ClangRenameCategory));
+  static cl::opt<bool> Rebuild(
+      "rebuild", cl::desc("Index every translation unit, even if <file> "
+                          "holds an index to update."),
+      cl::cat(ClangRenameCategory));
+
+  cl::ParseCommandLineOptions(argc, argv, IndexUsage);
+
+  std::string ErrorMessage;
+  std::unique_ptr<tooling::CompilationDatabase> Compilations(
+      tooling::CompilationDatabase::autoDetectFromDirectory(BuildPath,
+                                                            ErrorMessage));
+  if (!Compilations) {
+    errs() << "clang-rename: " << ErrorMessage << "\n";
+    return 1;
+  }
+
+  const auto TUs =
+      rename::getTranslationUnits(*Compilations, Compilations->getAllFiles());
+
+  rename::SymbolIndexBuilder Index;
+  auto Outdated = TUs;
+  if (!Rebuild && sys::fs::exists(OutputPath)) {
+    if (auto OldIndex = rename::SymbolIndex::load(OutputPath, ErrorMessage))
+      Outdated = Index.addUpToDate(*OldIndex, TUs);
+    else
+      errs() << "clang-rename: " << ErrorMessage << " Rebuilding "
+             << OutputPath << ".\n";
+  }
+
+  const unsigned NumWorkers = rename::getNumWorkers(Jobs, Outdated.size());
+
+  std::vector<rename::SymbolIndexBuilder> Builders(NumWorkers);
+  std::vector<std::unique_ptr<rename::IndexingAction>> IndexActions;
+  std::vector<std::unique_ptr<tooling::FrontendActionFactory>> Factories;
+  std::vector<tooling::ToolAction *> WorkerActions;
+  for (auto &Builder : Builders) {
+    IndexActions.emplace_back(new rename::IndexingAction(Builder));
+    Factories.push_back(
+        tooling::newFrontendActionFactory(IndexActions.back().get()));
+    WorkerActions.push_back(Factories.back().get());
+  }
+
+  // Every translation unit is done by a single worker, which sets its own
+  // element only.
+  std::vector<char> Succeeded(Outdated.size(), false);
+  int Result = rename::runOnTranslationUnits(
+      Outdated, WorkerActions,
+      [&Succeeded](size_t I, unsigned Worker, bool TUSucceeded) {
+        Succeeded[I] = TUSucceeded;
+      });
+  for (const auto &Builder : Builders)
+    Index.merge(Builder);
+  // Leave translation units that failed to parse to be retried next time.
+  for (size_t I = 0, E = Outdated.size(); I != E; ++I)
+    if (Succeeded[I])
+      Index.addTranslationUnit(Outdated[I]);
+
+  if (!Index.write(OutputPath, ErrorMessage)) {
+    errs() << "clang-rename: " << ErrorMessage << "\n";
+    return 1;
+  }
+  return Result;
+}
@@ -0,0 +1,401 @@
+//===--- tools/extra/clang-rename/ServerCommand.cpp - Clang rename tool ---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Implements clang-rename server, which keeps the compilation
+/// database and symbol index loaded and renames on request.
+///
+/// Clients connect to a Unix domain socket and send a request as one line:
+///
+///   rename <offset> <new-name> <file>
+///   query <offset> <file>
+///   reload
+///   shutdown
+///
+/// Each request is answered with zero or more lines of data and a final line
+/// that is either "ok [<name>]" or "error <message>". A rename overwrites the
+/// edited files and lists them as "file <path>" lines; a query lists the USRs
+/// of the symbol as "usr <usr>" lines. Its answer is the old name of the
+/// symbol. The server closes the connection once it answered, so a client
+/// that keeps it open cannot hold up the others; a client connects once per
+/// request. A client that has not sent its whole request within
+/// -request-timeout seconds is dropped for the same reason. Requests are
+/// served one at a time, each parsing with -j workers.
+///
+/// File contents are never cached between requests: files are expected to
+/// change between renames, and FileManagers live no longer than a request.
+/// The compilation database and the symbol index are loaded again once
+/// their files changed, e.g. after clang-rename gen-deps or index; reload
+/// forces it.
+///
+//===----------------------------------------------------------------------===//
+
+#include "Commands.h"
+#include "../RenameDriver.h"
+#include "../SymbolIndex.h"
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace llvm;
+using namespace clang;
+
+const char ServerUsage[] = "Serves renames on a Unix domain socket.\n\
+clang-rename server keeps the compilation database in <build-path> and\n\
+the symbol index loaded, and renames on requests sent to <socket>. See\n\
+support/rename.vim for a client.\n";
+
+namespace {
+// The size and modification time, in nanoseconds, of a file, or zeros if it
+// does not exist.
+struct FileStamp {
+  uint64_t Size, Time;
+
+  bool operator==(const FileStamp &Other) const {
+    return Size == Other.Size && Time == Other.Time;
+  }
+};
+
+// The files CompilationDatabase::autoDetectFromDirectory loads from.
+const char *const DatabaseFiles[] = { "compile_filedeps.json",
+                                      "compile_commands.json" };
+const size_t NumDatabaseFiles =
+    sizeof(DatabaseFiles) / sizeof(DatabaseFiles[0]);
+
+class Server {
+public:
+  Server(StringRef BuildPath, StringRef IndexPath, unsigned RequestTimeout)
+      : BuildPath(BuildPath), IndexPath(IndexPath),
+        RequestTimeout(RequestTimeout) {
+  }
+
+  // Loads the compilation database. The symbol index is loaded again when it
+  // is next used.
+  bool reload(std::string &ErrorMessage);
+
+  // Loads the compilation database again if its files changed since it was
+  // loaded.
+  bool update(std::string &ErrorMessage);
+
+  // Serves clients until one asks to shut down. Returns the exit code.
+  int run(StringRef SocketPath);
+
+private:
+  // Answers the request of the client connected to FD. Returns false on
+  // shutdown.
+  bool serve(int FD);
+
+  // Answers Request. Sets Shutdown if the server is to exit.
+  void handle(StringRef Request, raw_ostream &OS, bool &Shutdown);
+  void handleRename(StringRef Args, raw_ostream &OS);
+  void handleQuery(StringRef Args, raw_ostream &OS);
+
+  // Reloads the symbol index if it was rewritten since it was loaded.
+  const rename::SymbolIndex *getIndex();
+
+  // Sets Stamps to the stamps of DatabaseFiles in the build path.
+  void getDatabaseStamps(FileStamp *Stamps) const;
+
+  std::string BuildPath;
+  std::string IndexPath;
+  unsigned RequestTimeout;
+  std::unique_ptr<tooling::CompilationDatabase> Compilations;
+  FileStamp DatabaseStamps[NumDatabaseFiles];
+  std::unique_ptr<rename::SymbolIndex> Index;
+  FileStamp IndexStamp;
+};
+} // namespace
+
+static FileStamp getStamp(StringRef Path) {
+  FileStamp Stamp = { 0, 0 };
+  sys::fs::file_status Status;
+  if (sys::fs::status(Path, Status))
+    return Stamp;
+  const auto Modified = Status.getLastModificationTime();
+  Stamp.Size = Status.getSize();
+  Stamp.Time = Modified.toEpochTime() * 1000000000 + Modified.nanoseconds();
+  return Stamp;
+}
+
+void Server::getDatabaseStamps(FileStamp *Stamps) const {
+  for (size_t I = 0; I != NumDatabaseFiles; ++I) {
+    SmallString<256> Path(BuildPath);
+    sys::path::append(Path, DatabaseFiles[I]);
+    Stamps[I] = getStamp(Path);
+  }
+}
+
+bool Server::reload(std::string &ErrorMessage) {
+  // Stat before loading, so that a change made meanwhile is seen next time.
+  FileStamp Stamps[NumDatabaseFiles];
+  getDatabaseStamps(Stamps);
+
+  std::unique_ptr<tooling::CompilationDatabase> NewCompilations(
+      tooling::CompilationDatabase::autoDetectFromDirectory(BuildPath,
+                                                            ErrorMessage));
+  if (!NewCompilations)
+    return false;
+  // The index remembers which database it was checked against.
+  Index.reset();
+  Compilations = std::move(NewCompilations);
+  std::copy(Stamps, Stamps + NumDatabaseFiles, DatabaseStamps);
+  return true;
+}
+
+bool Server::update(std::string &ErrorMessage) {
+  FileStamp Stamps[NumDatabaseFiles];
+  getDatabaseStamps(Stamps);
+  if (std::equal(Stamps, Stamps + NumDatabaseFiles, DatabaseStamps))
+    return true;
+  return reload(ErrorMessage);
+}
+
+const rename::SymbolIndex *Server::getIndex() {
+  if (IndexPath.empty())
+    return nullptr;
+
+  const FileStamp Stamp = getStamp(IndexPath);
+  if (!Stamp.Time)
+    return nullptr;
+  if (Index && Stamp == IndexStamp)
+    return Index.get();
+
+  std::string ErrorMessage;
+  Index = rename::SymbolIndex::load(IndexPath, ErrorMessage);
+  if (!Index) {
+    errs() << "clang-rename: " << ErrorMessage << "\n";
+    return nullptr;
+  }
+  IndexStamp = Stamp;
+  return Index.get();
+}
+
+// Splits the leading offset off Args. Returns false if there is none.
+static bool consumeOffset(StringRef &Args, unsigned &Offset) {
+  StringRef Word;
+  std::tie(Word, Args) = Args.split(' ');
+  return !Word.getAsInteger(10, Offset);
+}
+
+void Server::handleRename(StringRef Args, raw_ostream &OS) {
+  rename::RenameOptions Options;
+  Options.Jobs = Jobs;
+  // Requests name a single file; the declaration tells where else to look.
+  Options.Dependents = true;
+  Options.Index = getIndex();
+  Options.TimesPath = getTimesPath();
+  Options.MaxMemory = uint64_t(MaxMemory) << 20;
+  Options.Isolate = Isolate;
+  Options.Timeout = Timeout;
+  Options.Retries = Retries;
+  Options.ExcludedPaths = ExcludedPaths;
+  Options.DedupHeaders = DedupHeaders;
+  StringRef NewName;
+  if (consumeOffset(Args, Options.Offset))
+    std::tie(NewName, Args) = Args.split(' ');
+  if (NewName.empty() || Args.empty()) {
+    OS << "error expected: rename <offset> <new-name> <file>\n";
+    return;
+  }
+  Options.NewName = NewName;
+
+  const std::string File = Args;
+  tooling::Replacements Replaces;
+  std::string PrevName;
+  int Result = rename::collectReplacements(*Compilations, File, Options,
+                                           Replaces, PrevName);
+  if (PrevName.empty()) {
+    OS << "error no symbol at offset " << Options.Offset << "\n";
+    return;
+  }
+
+  if (rename::applyReplacements(Replaces, /*Inplace=*/true, None, nulls()))
+    Result = 1;
+
+  std::set<std::string> Edited;
+  for (const auto &Replace : Replaces)
+    Edited.insert(Replace.getFilePath());
+  for (const auto &Path : Edited)
+    OS << "file " << Path << "\n";
+  if (Result)
+    OS << "error some files could not be renamed, see the server log\n";
+  else
+    OS << "ok " << PrevName << "\n";
+}
+
+void Server::handleQuery(StringRef Args, raw_ostream &OS) {
+  rename::RenameOptions Options;
+  if (!consumeOffset(Args, Options.Offset) || Args.empty()) {
+    OS << "error expected: query <offset> <file>\n";
+    return;
+  }
+
+  std::vector<std::string> USRs;
+  std::string Name;
+  rename::findUSRs(*Compilations, Args, Options, USRs, Name);
+  if (Name.empty()) {
+    OS << "error no symbol at offset " << Options.Offset << "\n";
+    return;
+  }
+  for (const auto &USR : USRs)
+    OS << "usr " << USR << "\n";
+  OS << "ok " << Name << "\n";
+}
+
+void Server::handle(StringRef Request, raw_ostream &OS, bool &Shutdown) {
+  StringRef Command, Args;
+  std::tie(Command, Args) = Request.rtrim("\r").split(' ');
+
+  std::string ErrorMessage;
+  if ((Command == "rename" || Command == "query") && !update(ErrorMessage)) {
+    OS << "error " << ErrorMessage << "\n";
+  } else if (Command == "rename") {
+    handleRename(Args, OS);
+  } else if (Command == "query") {
+    handleQuery(Args, OS);
+  } else if (Command == "reload") {
+    if (reload(ErrorMessage))
+      OS << "ok\n";
+    else
+      OS << "error " << ErrorMessage << "\n";
+  } else if (Command == "shutdown") {
+    Shutdown = true;
+    OS << "ok\n";
+  } else {
+    OS << "error unknown request: " << Command << "\n";
+  }
+  OS.flush();
+}
+
+bool Server::serve(int FD) {
+  raw_fd_ostream OS(FD, /*shouldClose=*/false, /*unbuffered=*/false);
+  std::string Pending;
+  bool Shutdown = false;
+  char Buffer[4096];
+  size_t End;
+  const auto Deadline = std::chrono::steady_clock::now() +
+                        std::chrono::seconds(RequestTimeout);
+  while ((End = Pending.find('\n')) == std::string::npos) {
+    const auto Left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        Deadline - std::chrono::steady_clock::now());
+    pollfd Poll = { FD, POLLIN, 0 };
+    int Ready = Left.count() > 0 ? ::poll(&Poll, 1, Left.count()) : 0;
+    if (Ready < 0 && errno == EINTR)
+      continue;
+    if (Ready == 0)
+      errs() << "clang-rename: dropped a client that sent no request within "
+             << RequestTimeout << " seconds.\n";
+    if (Ready <= 0)
+      return true;
+    ssize_t Read = ::read(FD, Buffer, sizeof(Buffer));
+    if (Read < 0 && errno == EINTR)
+      continue;
+    if (Read <= 0)
+      return true;
+    Pending.append(Buffer, Read);
+  }
+  // Anything after the request is ignored.
+  handle(Pending.substr(0, End), OS, Shutdown);
+  OS.clear_error();
+  return !Shutdown;
+}
+
+int Server::run(StringRef SocketPath) {
+  sockaddr_un Address;
+  memset(&Address, 0, sizeof(Address));
+  Address.sun_family = AF_UNIX;
+  if (SocketPath.size() >= sizeof(Address.sun_path)) {
+    errs() << "clang-rename: socket path too long: " << SocketPath << "\n";
+    return 1;
+  }
+  memcpy(Address.sun_path, SocketPath.data(), SocketPath.size());
+
+  int Listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (Listener < 0) {
+    errs() << "clang-rename: cannot create socket: " << strerror(errno)
+           << "\n";
+    return 1;
+  }
+
+  // A socket left behind by a server that was killed would fail bind().
+  sys::fs::remove(SocketPath);
+  if (::bind(Listener, reinterpret_cast<sockaddr *>(&Address),
+             sizeof(Address)) < 0 ||
+      ::listen(Listener, 8) < 0) {
+    errs() << "clang-rename: cannot listen on " << SocketPath << ": "
+           << strerror(errno) << "\n";
+    ::close(Listener);
+    return 1;
+  }
+  sys::RemoveFileOnSignal(SocketPath);
+  // A client going away must not take the server with it.
+  ::signal(SIGPIPE, SIG_IGN);
+
+  bool Running = true;
+  while (Running) {
+    int Client = ::accept(Listener, nullptr, nullptr);
+    if (Client < 0) {
+      if (errno == EINTR)
+        continue;
+      errs() << "clang-rename: accept failed: " << strerror(errno) << "\n";
+      break;
+    }
+    Running = serve(Client);
+    ::close(Client);
+  }
+
+  ::close(Listener);
+  sys::fs::remove(SocketPath);
+  sys::DontRemoveFileOnSignal(SocketPath);
+  return Running ? 1 : 0;
+}
+
+int serverMain(int argc, const char **argv) {
+  static cl::opt<std::string> BuildPath(
+      "p", cl::desc("Build path"), cl::value_desc("build-path"), cl::Required,
+      cl::cat(ClangRenameCategory));
+  static cl::opt<std::string> SocketPath(
+      "socket", cl::desc("Listen on the Unix domain socket <path>."),
+      cl::value_desc("path"), cl::Required, cl::cat(ClangRenameCategory));
+  static cl::opt<unsigned> RequestTimeout(
+      "request-timeout",
+      cl::desc("Drop a client that has not sent its whole request within "
+               "<seconds>."),
+      cl::value_desc("seconds"), cl::init(10), cl::cat(ClangRenameCategory));
+
+  cl::ParseCommandLineOptions(argc, argv, ServerUsage);
+
+  // -index is shared with renaming; the index is reloaded whenever
+  // clang-rename index updates it.
+  Server S(BuildPath, IndexPath, RequestTimeout);
+  std::string ErrorMessage;
+  if (!S.reload(ErrorMessage)) {
+    errs() << "clang-rename: " << ErrorMessage << "\n";
+    return 1;
+  }
+  return S.run(SocketPath);
+}